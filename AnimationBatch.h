@@ -0,0 +1,344 @@
+#pragma once
+
+// Batch pose evaluation. Instances that play the same clip are evaluated
+// together with their per-bone transforms laid out as structure of arrays,
+// one SIMD lane per instance. Define POSE_BATCH_SCALAR to force the scalar path.
+
+#if !defined(POSE_BATCH_SCALAR) && defined(__AVX__)
+#include <immintrin.h>
+#define POSE_BATCH_LANES 8
+typedef __m256 Lane;
+static inline Lane LaneLoad(const float* p) { return _mm256_loadu_ps(p); }
+static inline void LaneStore(float* p, Lane v) { _mm256_storeu_ps(p, v); }
+static inline Lane LaneSet(float v) { return _mm256_set1_ps(v); }
+static inline Lane LaneAdd(Lane a, Lane b) { return _mm256_add_ps(a, b); }
+static inline Lane LaneSub(Lane a, Lane b) { return _mm256_sub_ps(a, b); }
+static inline Lane LaneMul(Lane a, Lane b) { return _mm256_mul_ps(a, b); }
+static inline Lane LaneDiv(Lane a, Lane b) { return _mm256_div_ps(a, b); }
+static inline Lane LaneSqrt(Lane a) { return _mm256_sqrt_ps(a); }
+// negate a in every lane where s is negative
+static inline Lane LaneFlipSign(Lane a, Lane s) { return _mm256_xor_ps(a, _mm256_and_ps(s, _mm256_set1_ps(-0.0f))); }
+static inline Lane LaneAbs(Lane a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+#elif !defined(POSE_BATCH_SCALAR) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define POSE_BATCH_LANES 4
+typedef __m128 Lane;
+static inline Lane LaneLoad(const float* p) { return _mm_loadu_ps(p); }
+static inline void LaneStore(float* p, Lane v) { _mm_storeu_ps(p, v); }
+static inline Lane LaneSet(float v) { return _mm_set1_ps(v); }
+static inline Lane LaneAdd(Lane a, Lane b) { return _mm_add_ps(a, b); }
+static inline Lane LaneSub(Lane a, Lane b) { return _mm_sub_ps(a, b); }
+static inline Lane LaneMul(Lane a, Lane b) { return _mm_mul_ps(a, b); }
+static inline Lane LaneDiv(Lane a, Lane b) { return _mm_div_ps(a, b); }
+static inline Lane LaneSqrt(Lane a) { return _mm_sqrt_ps(a); }
+static inline Lane LaneFlipSign(Lane a, Lane s) { return _mm_xor_ps(a, _mm_and_ps(s, _mm_set1_ps(-0.0f))); }
+static inline Lane LaneAbs(Lane a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+#else
+#define POSE_BATCH_LANES 1
+typedef float Lane;
+static inline Lane LaneLoad(const float* p) { return *p; }
+static inline void LaneStore(float* p, Lane v) { *p = v; }
+static inline Lane LaneSet(float v) { return v; }
+static inline Lane LaneAdd(Lane a, Lane b) { return a + b; }
+static inline Lane LaneSub(Lane a, Lane b) { return a - b; }
+static inline Lane LaneMul(Lane a, Lane b) { return a * b; }
+static inline Lane LaneDiv(Lane a, Lane b) { return a / b; }
+static inline Lane LaneSqrt(Lane a) { return std::sqrt(a); }
+static inline Lane LaneFlipSign(Lane a, Lane s) { return s < 0 ? -a : a; }
+static inline Lane LaneAbs(Lane a) { return std::fabs(a); }
+#endif
+
+static inline Lane LaneMix(Lane a, Lane b, Lane t) { return LaneAdd(a, LaneMul(LaneSub(b, a), t)); }
+
+// instances evaluated together, keeps the scratch buffers in cache
+#define POSE_BATCH_MAX_INSTANCES 64
+
+// sample streams gathered per bone, one float per lane each
+#define SAMPLE_POSITION_A 0
+#define SAMPLE_POSITION_B 3
+#define SAMPLE_POSITION_T 6
+#define SAMPLE_ROTATION_A 7
+#define SAMPLE_ROTATION_B 11
+#define SAMPLE_ROTATION_T 15
+#define SAMPLE_SCALE_A 16
+#define SAMPLE_SCALE_B 19
+#define SAMPLE_SCALE_T 22
+#define SAMPLE_STREAMS 23
+
+// affine transforms are stored as the xyz of their four columns
+#define AFFINE_COMPONENTS 12
+
+struct PoseBatch
+{
+	std::vector<float> samples;
+	std::vector<float> locals;
+	std::vector<float> globals;
+	std::vector<float> constants;
+	std::vector<float> times;
+	int laneCount;
+};
+
+static void InitPoseBatch(PoseBatch* batch, int instanceCount, int boneCount)
+{
+	batch->laneCount = (instanceCount + POSE_BATCH_LANES - 1) / POSE_BATCH_LANES * POSE_BATCH_LANES;
+	batch->samples.assign(SAMPLE_STREAMS * batch->laneCount, 0.0f);
+	batch->locals.resize(AFFINE_COMPONENTS * batch->laneCount);
+	batch->globals.resize(boneCount * AFFINE_COMPONENTS * batch->laneCount);
+	batch->constants.resize(AFFINE_COMPONENTS * batch->laneCount);
+	batch->times.resize(instanceCount);
+
+	// padding lanes blend identity transforms
+	for (int lane = instanceCount; lane < batch->laneCount; lane++)
+	{
+		batch->samples[(SAMPLE_ROTATION_A + 3) * batch->laneCount + lane] = 1.0f;
+		batch->samples[(SAMPLE_ROTATION_B + 3) * batch->laneCount + lane] = 1.0f;
+		for (int k = 0; k < 3; k++)
+		{
+			batch->samples[(SAMPLE_SCALE_A + k) * batch->laneCount + lane] = 1.0f;
+			batch->samples[(SAMPLE_SCALE_B + k) * batch->laneCount + lane] = 1.0f;
+		}
+	}
+}
+
+static void GatherTrackSamples(PoseBatch* batch, BoneTransformTrack& btt, TrackCursor& cursor, float dt, int lane)
+{
+	int laneCount = batch->laneCount;
+	float* samples = batch->samples.data();
+	// constant and static channels have a single key, no search needed
+	std::pair<int, float> fp = { 0, 0.0f };
+
+	if (btt.positionKind == CHANNEL_ANIMATED) fp = GetTimeFraction(btt.positionTimestamps, dt, cursor.position);
+	glm::vec3& position1 = btt.positions[std::max(fp.first - 1, 0)];
+	glm::vec3& position2 = btt.positions[fp.first];
+	for (int k = 0; k < 3; k++)
+	{
+		samples[(SAMPLE_POSITION_A + k) * laneCount + lane] = position1[k];
+		samples[(SAMPLE_POSITION_B + k) * laneCount + lane] = position2[k];
+	}
+	samples[SAMPLE_POSITION_T * laneCount + lane] = fp.second;
+
+	fp = { 0, 0.0f };
+	if (btt.rotationKind == CHANNEL_ANIMATED) fp = GetTimeFraction(btt.rotationTimestamps, dt, cursor.rotation);
+	glm::quat rotation1 = GetTrackRotation(btt, std::max(fp.first - 1, 0));
+	glm::quat rotation2 = GetTrackRotation(btt, fp.first);
+	for (int k = 0; k < 4; k++)
+	{
+		samples[(SAMPLE_ROTATION_A + k) * laneCount + lane] = rotation1[k];
+		samples[(SAMPLE_ROTATION_B + k) * laneCount + lane] = rotation2[k];
+	}
+	samples[SAMPLE_ROTATION_T * laneCount + lane] = fp.second;
+
+	fp = { 0, 0.0f };
+	if (btt.scaleKind == CHANNEL_ANIMATED) fp = GetTimeFraction(btt.scaleTimestamps, dt, cursor.scale);
+	glm::vec3& scale1 = btt.scales[std::max(fp.first - 1, 0)];
+	glm::vec3& scale2 = btt.scales[fp.first];
+	for (int k = 0; k < 3; k++)
+	{
+		samples[(SAMPLE_SCALE_A + k) * laneCount + lane] = scale1[k];
+		samples[(SAMPLE_SCALE_B + k) * laneCount + lane] = scale2[k];
+	}
+	samples[SAMPLE_SCALE_T * laneCount + lane] = fp.second;
+}
+
+// Blend the gathered keys and build translate * rotate * scale for every lane.
+// Rotations use nlerp with a cubic correction of t, which stays within a
+// fraction of a degree of slerp without any trigonometry.
+static void BlendLocalTransforms(PoseBatch* batch)
+{
+	int laneCount = batch->laneCount;
+	const float* samples = batch->samples.data();
+	float* locals = batch->locals.data();
+	Lane one = LaneSet(1.0f);
+	Lane two = LaneSet(2.0f);
+	Lane half = LaneSet(0.5f);
+
+	for (int lane = 0; lane < laneCount; lane += POSE_BATCH_LANES)
+	{
+		const float* s = samples + lane;
+		float* l = locals + lane;
+
+		Lane pt = LaneLoad(s + SAMPLE_POSITION_T * laneCount);
+		Lane tx = LaneMix(LaneLoad(s + (SAMPLE_POSITION_A + 0) * laneCount), LaneLoad(s + (SAMPLE_POSITION_B + 0) * laneCount), pt);
+		Lane ty = LaneMix(LaneLoad(s + (SAMPLE_POSITION_A + 1) * laneCount), LaneLoad(s + (SAMPLE_POSITION_B + 1) * laneCount), pt);
+		Lane tz = LaneMix(LaneLoad(s + (SAMPLE_POSITION_A + 2) * laneCount), LaneLoad(s + (SAMPLE_POSITION_B + 2) * laneCount), pt);
+
+		Lane st = LaneLoad(s + SAMPLE_SCALE_T * laneCount);
+		Lane sx = LaneMix(LaneLoad(s + (SAMPLE_SCALE_A + 0) * laneCount), LaneLoad(s + (SAMPLE_SCALE_B + 0) * laneCount), st);
+		Lane sy = LaneMix(LaneLoad(s + (SAMPLE_SCALE_A + 1) * laneCount), LaneLoad(s + (SAMPLE_SCALE_B + 1) * laneCount), st);
+		Lane sz = LaneMix(LaneLoad(s + (SAMPLE_SCALE_A + 2) * laneCount), LaneLoad(s + (SAMPLE_SCALE_B + 2) * laneCount), st);
+
+		Lane ax = LaneLoad(s + (SAMPLE_ROTATION_A + 0) * laneCount);
+		Lane ay = LaneLoad(s + (SAMPLE_ROTATION_A + 1) * laneCount);
+		Lane az = LaneLoad(s + (SAMPLE_ROTATION_A + 2) * laneCount);
+		Lane aw = LaneLoad(s + (SAMPLE_ROTATION_A + 3) * laneCount);
+		Lane bx = LaneLoad(s + (SAMPLE_ROTATION_B + 0) * laneCount);
+		Lane by = LaneLoad(s + (SAMPLE_ROTATION_B + 1) * laneCount);
+		Lane bz = LaneLoad(s + (SAMPLE_ROTATION_B + 2) * laneCount);
+		Lane bw = LaneLoad(s + (SAMPLE_ROTATION_B + 3) * laneCount);
+		Lane rt = LaneLoad(s + SAMPLE_ROTATION_T * laneCount);
+
+		// take the shortest path
+		Lane d = LaneAdd(LaneAdd(LaneMul(ax, bx), LaneMul(ay, by)), LaneAdd(LaneMul(az, bz), LaneMul(aw, bw)));
+		bx = LaneFlipSign(bx, d);
+		by = LaneFlipSign(by, d);
+		bz = LaneFlipSign(bz, d);
+		bw = LaneFlipSign(bw, d);
+		d = LaneAbs(d);
+
+		Lane ka = LaneAdd(LaneSet(1.0904f), LaneMul(d, LaneAdd(LaneSet(-3.2452f), LaneMul(d, LaneSub(LaneSet(3.55645f), LaneMul(d, LaneSet(1.43519f)))))));
+		Lane kb = LaneAdd(LaneSet(0.848013f), LaneMul(d, LaneAdd(LaneSet(-1.06021f), LaneMul(d, LaneSet(0.215638f)))));
+		Lane centered = LaneSub(rt, half);
+		Lane k = LaneAdd(LaneMul(ka, LaneMul(centered, centered)), kb);
+		rt = LaneAdd(rt, LaneMul(LaneMul(rt, centered), LaneMul(LaneSub(rt, one), k)));
+
+		Lane qx = LaneMix(ax, bx, rt);
+		Lane qy = LaneMix(ay, by, rt);
+		Lane qz = LaneMix(az, bz, rt);
+		Lane qw = LaneMix(aw, bw, rt);
+		Lane length = LaneSqrt(LaneAdd(LaneAdd(LaneMul(qx, qx), LaneMul(qy, qy)), LaneAdd(LaneMul(qz, qz), LaneMul(qw, qw))));
+		Lane inverseLength = LaneDiv(one, length);
+		qx = LaneMul(qx, inverseLength);
+		qy = LaneMul(qy, inverseLength);
+		qz = LaneMul(qz, inverseLength);
+		qw = LaneMul(qw, inverseLength);
+
+		Lane xx = LaneMul(qx, qx), yy = LaneMul(qy, qy), zz = LaneMul(qz, qz);
+		Lane xy = LaneMul(qx, qy), xz = LaneMul(qx, qz), yz = LaneMul(qy, qz);
+		Lane wx = LaneMul(qw, qx), wy = LaneMul(qw, qy), wz = LaneMul(qw, qz);
+
+		LaneStore(l + 0 * laneCount, LaneMul(LaneSub(one, LaneMul(two, LaneAdd(yy, zz))), sx));
+		LaneStore(l + 1 * laneCount, LaneMul(LaneMul(two, LaneAdd(xy, wz)), sx));
+		LaneStore(l + 2 * laneCount, LaneMul(LaneMul(two, LaneSub(xz, wy)), sx));
+
+		LaneStore(l + 3 * laneCount, LaneMul(LaneMul(two, LaneSub(xy, wz)), sy));
+		LaneStore(l + 4 * laneCount, LaneMul(LaneSub(one, LaneMul(two, LaneAdd(xx, zz))), sy));
+		LaneStore(l + 5 * laneCount, LaneMul(LaneMul(two, LaneAdd(yz, wx)), sy));
+
+		LaneStore(l + 6 * laneCount, LaneMul(LaneMul(two, LaneAdd(xz, wy)), sz));
+		LaneStore(l + 7 * laneCount, LaneMul(LaneMul(two, LaneSub(yz, wx)), sz));
+		LaneStore(l + 8 * laneCount, LaneMul(LaneSub(one, LaneMul(two, LaneAdd(xx, yy))), sz));
+
+		LaneStore(l + 9 * laneCount, tx);
+		LaneStore(l + 10 * laneCount, ty);
+		LaneStore(l + 11 * laneCount, tz);
+	}
+}
+
+static void BroadcastAffine(float* output, const glm::mat4& m, int laneCount)
+{
+	for (int c = 0; c < 4; c++)
+	{
+		for (int r = 0; r < 3; r++)
+		{
+			std::fill_n(output + (c * 3 + r) * laneCount, laneCount, m[c][r]);
+		}
+	}
+}
+
+// output = a * b for every lane, all three arrays are affine SoA
+static void MultiplyAffine(float* output, const float* a, const float* b, int laneCount)
+{
+	for (int lane = 0; lane < laneCount; lane += POSE_BATCH_LANES)
+	{
+		Lane ac[AFFINE_COMPONENTS];
+		Lane bc[AFFINE_COMPONENTS];
+		for (int k = 0; k < AFFINE_COMPONENTS; k++)
+		{
+			ac[k] = LaneLoad(a + k * laneCount + lane);
+			bc[k] = LaneLoad(b + k * laneCount + lane);
+		}
+
+		for (int c = 0; c < 4; c++)
+		{
+			for (int r = 0; r < 3; r++)
+			{
+				Lane v = LaneAdd(LaneAdd(LaneMul(ac[0 + r], bc[c * 3 + 0]), LaneMul(ac[3 + r], bc[c * 3 + 1])), LaneMul(ac[6 + r], bc[c * 3 + 2]));
+				if (c == 3)
+				{
+					v = LaneAdd(v, ac[9 + r]);
+				}
+				LaneStore(output + (c * 3 + r) * laneCount + lane, v);
+			}
+		}
+	}
+}
+
+// Evaluate instances that all play the same clip. times holds each instance's clip time,
+// reduced holds detail bones at their bind transform like GetPose.
+static void EvaluatePoseBatch(AnimationInstance** instances, const float* times, int count, bool reduced = false)
+{
+	if (count <= 0) return;
+	thread_local PoseBatch batch = {};
+
+	Animation* animation = instances[0]->animation;
+	Skeleton* skeleton = animation->skeleton.get();
+
+	for (int first = 0; first < count; first += POSE_BATCH_MAX_INSTANCES)
+	{
+		int chunk = std::min(count - first, POSE_BATCH_MAX_INSTANCES);
+		AnimationInstance** chunkInstances = instances + first;
+		InitPoseBatch(&batch, chunk, skeleton->count);
+		int laneCount = batch.laneCount;
+
+		for (int lane = 0; lane < chunk; lane++)
+		{
+			chunkInstances[lane]->time = times[first + lane];
+			batch.times[lane] = fmod(times[first + lane], animation->duration);
+		}
+
+		for (int i = 0; i < skeleton->count; i++)
+		{
+			BoneTransformTrack& btt = animation->tracks[i];
+			if (btt.positionTimestamps.empty() || (reduced && skeleton->detailBones[i]))
+			{
+				BroadcastAffine(batch.locals.data(), skeleton->bindTransforms[i], laneCount);
+			}
+			else if (btt.positionKind != CHANNEL_ANIMATED && btt.rotationKind != CHANNEL_ANIMATED && btt.scaleKind != CHANNEL_ANIMATED)
+			{
+				// same local transform for every lane
+				BroadcastAffine(batch.locals.data(), SampleTrack(btt, chunkInstances[0]->cursors[i], 0.0f), laneCount);
+			}
+			else
+			{
+				for (int lane = 0; lane < chunk; lane++)
+				{
+					GatherTrackSamples(&batch, btt, chunkInstances[lane]->cursors[i], batch.times[lane], lane);
+				}
+				BlendLocalTransforms(&batch);
+			}
+
+			float* global = batch.globals.data() + i * AFFINE_COMPONENTS * laneCount;
+			int parent = skeleton->parents[i];
+			if (parent < 0)
+			{
+				std::copy(batch.locals.begin(), batch.locals.end(), global);
+			}
+			else
+			{
+				MultiplyAffine(global, batch.globals.data() + parent * AFFINE_COMPONENTS * laneCount, batch.locals.data(), laneCount);
+			}
+		}
+
+		// skinning matrix = globalInverseTransform * global * offset
+		BroadcastAffine(batch.constants.data(), animation->globalInverseTransform, laneCount);
+		for (int i = 0; i < skeleton->count; i++)
+		{
+			float* global = batch.globals.data() + i * AFFINE_COMPONENTS * laneCount;
+			MultiplyAffine(batch.locals.data(), batch.constants.data(), global, laneCount);
+			BroadcastAffine(global, skeleton->offsets[i], laneCount);
+			MultiplyAffine(global, batch.locals.data(), global, laneCount);
+
+			for (int lane = 0; lane < chunk; lane++)
+			{
+				glm::mat4& m = chunkInstances[lane]->pose[i];
+				for (int c = 0; c < 4; c++)
+				{
+					m[c][0] = global[(c * 3 + 0) * laneCount + lane];
+					m[c][1] = global[(c * 3 + 1) * laneCount + lane];
+					m[c][2] = global[(c * 3 + 2) * laneCount + lane];
+					m[c][3] = c == 3 ? 1.0f : 0.0f;
+				}
+			}
+		}
+	}
+}
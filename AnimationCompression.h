@@ -0,0 +1,191 @@
+#pragma once
+
+// Optional compression stage for compiled clips. Keys that linear
+// interpolation reproduces within the error bound are removed, channels that
+// never move collapse to a single key and rotations can be quantized to 48 bits.
+
+struct AnimationCompressionSettings
+{
+	// the stage is lossy, clips keep every key unless it is turned on
+	bool enabled = false;
+	// largest error allowed at any removed key
+	float positionError = 0.01f;
+	// radians
+	float rotationError = 0.001f;
+	float scaleError = 0.001f;
+	bool quantizeRotations = true;
+};
+
+// same interpolation SampleTrack uses
+static glm::vec3 InterpolateKeys(const glm::vec3& a, const glm::vec3& b, float t)
+{
+	return glm::mix(a, b, t);
+}
+
+static glm::quat InterpolateKeys(const glm::quat& a, const glm::quat& b, float t)
+{
+	return glm::slerp(a, b, t);
+}
+
+// Greedy reduction, every segment is grown until one of the keys it would
+// skip can no longer be reproduced within maxError.
+template <typename T>
+static void ReduceKeys(std::vector<float>& timestamps, std::vector<T>& values, float maxError)
+{
+	int keyCount = timestamps.size();
+	if (keyCount <= 1) return;
+
+	bool constant = true;
+	for (int i = 1; i < keyCount && constant; i++)
+	{
+		constant = KeyError(values[i], values[0]) <= maxError;
+	}
+	if (constant)
+	{
+		timestamps.resize(1);
+		values.resize(1);
+		timestamps.shrink_to_fit();
+		values.shrink_to_fit();
+		return;
+	}
+
+	std::vector<float> keptTimestamps = { timestamps[0] };
+	std::vector<T> keptValues = { values[0] };
+	int anchor = 0;
+	for (int end = 2; end < keyCount; end++)
+	{
+		float span = timestamps[end] - timestamps[anchor];
+		bool fits = true;
+		for (int k = anchor + 1; k < end && fits; k++)
+		{
+			float t = span > 0.0f ? (timestamps[k] - timestamps[anchor]) / span : 0.0f;
+			fits = KeyError(InterpolateKeys(values[anchor], values[end], t), values[k]) <= maxError;
+		}
+		if (!fits)
+		{
+			anchor = end - 1;
+			keptTimestamps.push_back(timestamps[anchor]);
+			keptValues.push_back(values[anchor]);
+		}
+	}
+	keptTimestamps.push_back(timestamps[keyCount - 1]);
+	keptValues.push_back(values[keyCount - 1]);
+
+	timestamps.swap(keptTimestamps);
+	values.swap(keptValues);
+}
+
+static PackedQuat PackRotation(glm::quat rotation)
+{
+	int largest = 0;
+	for (int k = 1; k < 4; k++)
+	{
+		if (std::fabs(rotation[k]) > std::fabs(rotation[largest])) largest = k;
+	}
+	// q and -q are the same rotation, keep the largest component positive
+	float sign = rotation[largest] < 0.0f ? -1.0f : 1.0f;
+
+	unsigned long long bits = largest;
+	for (int k = 3; k >= 0; k--)
+	{
+		if (k == largest) continue;
+		float value = glm::clamp(rotation[k] * sign * 1.41421356f, -1.0f, 1.0f);
+		bits = (bits << 15) | (unsigned long long)std::lround((value + 1.0f) * 0.5f * 32767.0f);
+	}
+
+	PackedQuat packed;
+	packed.data[0] = (unsigned short)(bits >> 32);
+	packed.data[1] = (unsigned short)(bits >> 16);
+	packed.data[2] = (unsigned short)bits;
+	return packed;
+}
+
+static size_t GetTrackMemory(BoneTransformTrack& btt)
+{
+	return (btt.positionTimestamps.size() + btt.rotationTimestamps.size() + btt.scaleTimestamps.size()) * sizeof(float)
+		+ btt.positions.size() * sizeof(glm::vec3)
+		+ btt.rotations.size() * sizeof(glm::quat)
+		+ btt.scales.size() * sizeof(glm::vec3)
+		+ btt.packedRotations.size() * sizeof(PackedQuat);
+}
+
+static size_t GetAnimationMemory(Animation* animation)
+{
+	size_t bytes = 0;
+	for (int i = 0; i < animation->tracks.size(); i++)
+	{
+		bytes += GetTrackMemory(animation->tracks[i]);
+	}
+	return bytes;
+}
+
+static void CompressAnimation(Animation* animation, const AnimationCompressionSettings& settings)
+{
+	for (int i = 0; i < animation->tracks.size(); i++)
+	{
+		BoneTransformTrack& btt = animation->tracks[i];
+		ReduceKeys(btt.positionTimestamps, btt.positions, settings.positionError);
+		ReduceKeys(btt.scaleTimestamps, btt.scales, settings.scaleError);
+		ReduceKeys(btt.rotationTimestamps, btt.rotations, settings.rotationError);
+		// reduction can leave channels constant, pick their samplers again
+		ClassifyTrack(btt, animation->skeleton.get(), i);
+
+		if (settings.quantizeRotations && !btt.rotations.empty())
+		{
+			btt.packedRotations.resize(btt.rotations.size());
+			for (int k = 0; k < btt.rotations.size(); k++)
+			{
+				btt.packedRotations[k] = PackRotation(btt.rotations[k]);
+			}
+			btt.rotations.clear();
+			btt.rotations.shrink_to_fit();
+		}
+	}
+}
+
+// Compressed clips keep their source tracks, so the stage can be turned off
+// or rerun with other settings while the program runs
+struct AnimationCompression
+{
+	AnimationCompressionSettings settings;
+	std::vector<std::vector<BoneTransformTrack>> sourceTracks;
+};
+
+// Rebuild every clip from its source tracks with the current settings and
+// report the key memory before and after
+static void CompressAnimations(std::vector<Animation>& animations, AnimationCompression* compression)
+{
+	std::vector<std::vector<BoneTransformTrack>>& sourceTracks = compression->sourceTracks;
+	if (!compression->settings.enabled && sourceTracks.empty()) return;
+
+	// clips added since the last run are still uncompressed
+	for (int i = sourceTracks.size(); i < animations.size(); i++)
+	{
+		sourceTracks.push_back(animations[i].tracks);
+	}
+
+	size_t totalBefore = 0;
+	size_t totalAfter = 0;
+	for (int i = 0; i < animations.size(); i++)
+	{
+		if (animations[i].tracks.empty() && sourceTracks[i].empty()) continue;
+		animations[i].tracks = sourceTracks[i];
+		totalBefore += GetAnimationMemory(&animations[i]);
+		if (compression->settings.enabled)
+		{
+			CompressAnimation(&animations[i], compression->settings);
+		}
+		totalAfter += GetAnimationMemory(&animations[i]);
+
+		// baked palettes were sampled from the old keys
+		Texture* palette = &animations[i].bakedPalette;
+		if (palette->id) glDeleteTextures(1, &palette->id);
+		palette->id = 0;
+	}
+
+	if (!compression->settings.enabled)
+	{
+		sourceTracks.clear();
+	}
+	std::cout << "Animation keys: " << totalBefore << " -> " << totalAfter << " bytes" << std::endl;
+}
@@ -0,0 +1,598 @@
+#pragma once
+
+// Binary cache of imported assets. The first import of a source file through
+// Assimp writes <source>.asset next to it, later loads map that file and copy
+// its arrays straight out instead of parsing the source again. Meshes are
+// stored as the packed GL streams and clips as compiled tracks, so a cache hit
+// goes straight to the upload. The cache is keyed by an FNV-1a hash of the
+// source bytes and of the import settings, so editing either rebuilds it.
+//
+// An import profile names the vertex attributes the mesh's shaders read, the
+// post processing and components nothing reads are left out of the import.
+
+#define ASSET_MAGIC 0x54535341
+// bump whenever the importer or the packed layout changes what a cache holds
+#define ASSET_VERSION 4
+#define ASSET_IMPORT_FLAGS (aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_FlipUVs | aiProcess_CalcTangentSpace)
+// clips only read the node tree and the channels, no mesh post processing
+#define ASSET_ANIMATION_IMPORT_FLAGS 0
+
+// what an import keeps from the source
+#define ASSET_IMPORT_ALL 0
+// clip files, bound by bone name to the skeleton of another asset
+#define ASSET_IMPORT_ANIMATIONS 1
+
+// What an import keeps from one source
+struct ImportProfile
+{
+	int contents;
+	// VERTEX_* attributes the shaders drawing the mesh read, skin weights are
+	// always imported
+	int vertexFormat;
+};
+
+static const ImportProfile fullImportProfile = { ASSET_IMPORT_ALL, VERTEX_ALL };
+static const ImportProfile animationImportProfile = { ASSET_IMPORT_ANIMATIONS, 0 };
+
+#define FNV_OFFSET_BASIS 14695981039346656037ull
+#define FNV_PRIME 1099511628211ull
+
+// Everything the resources take from one source file, only the clips for
+// ASSET_IMPORT_ANIMATIONS. Clips of a file with a skeleton come compiled
+// against it. Clip files have no skeleton of their own, their channels stay
+// keyed by node name until BindAnimations ties them to the skeleton of
+// another file.
+struct ImportedAsset
+{
+	// merged, skinned, optimized and packed for UploadMesh
+	PackedMesh mesh;
+	// nullptr when no mesh has bones
+	std::shared_ptr<Skeleton> skeleton;
+	std::vector<Animation> animations;
+	// HashFile of the source, set by LoadAsset
+	unsigned long long sourceHash;
+};
+
+struct AssetHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned long long key;
+};
+
+static unsigned long long HashBytes(const void* data, size_t size, unsigned long long hash = FNV_OFFSET_BASIS)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+// Profile of a mesh drawn by any of programs, vertexFormat holds what their
+// linked vertex shaders actually read
+static ImportProfile GetImportProfile(std::vector<ShaderProgram*> programs)
+{
+	ImportProfile profile = { ASSET_IMPORT_ALL, VERTEX_SKIN };
+	for (int i = 0; i < programs.size(); i++)
+	{
+		profile.vertexFormat |= programs[i]->vertexFormat;
+	}
+	return profile;
+}
+
+// aiComponent_* flags for aiProcess_RemoveComponent. Removing them before
+// JoinIdenticalVertices also merges vertices split only by unused attributes.
+static int GetRemovedComponents(ImportProfile profile)
+{
+	if (profile.contents == ASSET_IMPORT_ANIMATIONS) return 0;
+	int format = profile.vertexFormat;
+	int removed = 0;
+	// tangents are generated from the normals and uvs
+	if (!(format & (VERTEX_NORMAL | VERTEX_TANGENT))) removed |= aiComponent_NORMALS;
+	if (!(format & VERTEX_TANGENT)) removed |= aiComponent_TANGENTS_AND_BITANGENTS;
+	if (!(format & VERTEX_COLOR)) removed |= aiComponent_COLORS;
+	if (!(format & (VERTEX_UV | VERTEX_TANGENT))) removed |= aiComponent_TEXCOORDS;
+	return removed;
+}
+
+static int GetAssetImportFlags(ImportProfile profile)
+{
+	if (profile.contents == ASSET_IMPORT_ANIMATIONS) return ASSET_ANIMATION_IMPORT_FLAGS;
+	int flags = ASSET_IMPORT_FLAGS;
+	if (!(profile.vertexFormat & (VERTEX_UV | VERTEX_TANGENT))) flags &= ~aiProcess_FlipUVs;
+	if (!(profile.vertexFormat & VERTEX_TANGENT)) flags &= ~aiProcess_CalcTangentSpace;
+	if (GetRemovedComponents(profile)) flags |= aiProcess_RemoveComponent;
+	return flags;
+}
+
+// Hash of the bytes of a file, 0 when it can't be read
+static unsigned long long HashFile(const std::string& path)
+{
+	MappedFile file;
+	if (!MapFile(path, &file)) return 0;
+	unsigned long long hash = HashBytes(file.data, file.size);
+	UnmapFile(&file);
+	return hash;
+}
+
+// Hash of the source and of everything that changes what its import
+// produces, 0 when the source can't be read
+static unsigned long long GetAssetKey(unsigned long long sourceHash, ImportProfile profile)
+{
+	if (!sourceHash) return 0;
+	int settings[] = { ASSET_VERSION, profile.contents, GetAssetImportFlags(profile), GetRemovedComponents(profile), ATTRIBUTE_STRIDE, SKIN_WEIGHT_BITS, MAX_BONE_INFLUENCE, VERTEX_CACHE_SIZE };
+	return HashBytes(settings, sizeof(settings), sourceHash);
+}
+
+static unsigned long long GetAssetKey(const std::string& sourcePath, ImportProfile profile)
+{
+	return GetAssetKey(HashFile(sourcePath), profile);
+}
+
+// every profile of one source keeps a cache of its own
+static std::string GetAssetCachePath(const std::string& sourcePath, ImportProfile profile)
+{
+	if (profile.contents == ASSET_IMPORT_ANIMATIONS) return sourcePath + ".anim.asset";
+	if (profile.vertexFormat == VERTEX_ALL) return sourcePath + ".asset";
+	return sourcePath + ".v" + std::to_string(profile.vertexFormat) + ".asset";
+}
+
+static void WriteBytes(std::vector<char>& output, const void* data, size_t size)
+{
+	output.insert(output.end(), (const char*)data, (const char*)data + size);
+}
+
+template<typename T>
+static void WriteValue(std::vector<char>& output, const T& value)
+{
+	WriteBytes(output, &value, sizeof(T));
+}
+
+// element count followed by the elements, T is copied bytewise
+template<typename T>
+static void WriteArray(std::vector<char>& output, const std::vector<T>& values)
+{
+	WriteValue(output, (unsigned int)values.size());
+	WriteBytes(output, values.data(), values.size() * sizeof(T));
+}
+
+static void WriteString(std::vector<char>& output, const std::string& value)
+{
+	WriteValue(output, (unsigned int)value.size());
+	WriteBytes(output, value.data(), value.size());
+}
+
+static void WriteTrack(std::vector<char>& output, const BoneTransformTrack& track)
+{
+	WriteArray(output, track.positionTimestamps);
+	WriteArray(output, track.rotationTimestamps);
+	WriteArray(output, track.scaleTimestamps);
+	WriteArray(output, track.positions);
+	WriteArray(output, track.rotations);
+	WriteArray(output, track.scales);
+	WriteArray(output, track.packedRotations);
+	WriteValue(output, track.positionKind);
+	WriteValue(output, track.rotationKind);
+	WriteValue(output, track.scaleKind);
+}
+
+static std::vector<char> SerializeAsset(ImportedAsset* asset, unsigned long long key)
+{
+	std::vector<char> output;
+	AssetHeader header = { ASSET_MAGIC, ASSET_VERSION, key };
+	WriteValue(output, header);
+
+	PackedMesh& mesh = asset->mesh;
+	WriteArray(output, mesh.positions);
+	WriteArray(output, mesh.attributes);
+	WriteArray(output, mesh.colors);
+	WriteArray(output, mesh.skin);
+	WriteValue(output, mesh.skinIndexBits);
+	WriteValue(output, mesh.skinWeightBits);
+	WriteArray(output, mesh.indices);
+	WriteValue(output, mesh.indexCount);
+	WriteValue(output, mesh.indexType);
+	WriteArray(output, mesh.submeshes);
+	WriteValue(output, mesh.boundsCenter);
+	WriteValue(output, mesh.boundsRadius);
+
+	Skeleton* skeleton = asset->skeleton.get();
+	WriteValue(output, skeleton ? skeleton->count : -1);
+	if (skeleton)
+	{
+		for (int i = 0; i < skeleton->count; i++)
+		{
+			WriteString(output, skeleton->names[i]);
+		}
+		WriteArray(output, skeleton->parents);
+		WriteArray(output, skeleton->offsets);
+		WriteArray(output, skeleton->bindTransforms);
+		WriteArray(output, skeleton->bindPositions);
+		WriteArray(output, skeleton->bindRotations);
+		WriteArray(output, skeleton->bindScales);
+		WriteArray(output, std::vector<unsigned char>(skeleton->detailBones.begin(), skeleton->detailBones.end()));
+	}
+
+	WriteValue(output, (unsigned int)asset->animations.size());
+	for (int i = 0; i < asset->animations.size(); i++)
+	{
+		Animation& animation = asset->animations[i];
+		WriteString(output, animation.name);
+		WriteValue(output, animation.duration);
+		WriteValue(output, animation.ticksPersecond);
+		WriteValue(output, animation.globalInverseTransform);
+		// compiled tracks by bone id, or -1 and the channels by node name
+		bool compiled = animation.skeleton && animation.skeleton == asset->skeleton;
+		WriteValue(output, compiled ? (int)animation.tracks.size() : -1);
+		if (compiled)
+		{
+			for (int j = 0; j < animation.tracks.size(); j++)
+			{
+				WriteTrack(output, animation.tracks[j]);
+			}
+			continue;
+		}
+		WriteValue(output, (unsigned int)animation.boneTransforms.size());
+		for (auto& channel : animation.boneTransforms)
+		{
+			WriteString(output, channel.first);
+			WriteTrack(output, channel.second);
+		}
+	}
+	return output;
+}
+
+// Cursor over a mapped cache, once a read runs past the end every later read fails
+struct AssetReader
+{
+	const char* data;
+	size_t size;
+	size_t offset;
+	bool valid;
+};
+
+static bool ReadBytes(AssetReader* reader, void* data, size_t size)
+{
+	if (!reader->valid || reader->size - reader->offset < size)
+	{
+		reader->valid = false;
+		return false;
+	}
+	if (size) memcpy(data, reader->data + reader->offset, size);
+	reader->offset += size;
+	return true;
+}
+
+template<typename T>
+static bool ReadValue(AssetReader* reader, T& value)
+{
+	return ReadBytes(reader, &value, sizeof(T));
+}
+
+template<typename T>
+static bool ReadArray(AssetReader* reader, std::vector<T>& values)
+{
+	unsigned int count = 0;
+	if (!ReadValue(reader, count)) return false;
+	if (count > (reader->size - reader->offset) / sizeof(T))
+	{
+		reader->valid = false;
+		return false;
+	}
+	values.resize(count);
+	return ReadBytes(reader, values.data(), count * sizeof(T));
+}
+
+static bool ReadString(AssetReader* reader, std::string& value)
+{
+	unsigned int length = 0;
+	if (!ReadValue(reader, length)) return false;
+	if (length > reader->size - reader->offset)
+	{
+		reader->valid = false;
+		return false;
+	}
+	value.assign(reader->data + reader->offset, length);
+	reader->offset += length;
+	return true;
+}
+
+static void ReadTrack(AssetReader* reader, BoneTransformTrack& track)
+{
+	ReadArray(reader, track.positionTimestamps);
+	ReadArray(reader, track.rotationTimestamps);
+	ReadArray(reader, track.scaleTimestamps);
+	ReadArray(reader, track.positions);
+	ReadArray(reader, track.rotations);
+	ReadArray(reader, track.scales);
+	ReadArray(reader, track.packedRotations);
+	ReadValue(reader, track.positionKind);
+	ReadValue(reader, track.rotationKind);
+	ReadValue(reader, track.scaleKind);
+	// every key time needs its key, sampling indexes both with one cursor
+	bool rotations = track.rotationTimestamps.size() == (track.packedRotations.empty() ? track.rotations.size() : track.packedRotations.size());
+	bool complete = track.positionTimestamps.size() == track.positions.size() && rotations && track.scaleTimestamps.size() == track.scales.size();
+	reader->valid = reader->valid && complete;
+}
+
+// Stream sizes agree and every index stays inside its submesh, so a damaged
+// cache is imported again instead of drawing out of bounds
+static bool IsPackedMeshValid(PackedMesh* mesh)
+{
+	size_t vertexCount = mesh->positions.size();
+	if (mesh->attributes.size() != vertexCount * ATTRIBUTE_STRIDE / 4) return false;
+	if (!mesh->colors.empty() && mesh->colors.size() != vertexCount) return false;
+	if (!mesh->skin.empty())
+	{
+		bool bits = (mesh->skinIndexBits == 8 || mesh->skinIndexBits == 16) && (mesh->skinWeightBits == 8 || mesh->skinWeightBits == 16);
+		if (!bits || mesh->skin.size() != vertexCount * GetSkinStride(mesh->skinIndexBits, mesh->skinWeightBits)) return false;
+	}
+	if (mesh->indexType != GL_UNSIGNED_SHORT && mesh->indexType != GL_UNSIGNED_INT) return false;
+	size_t indexSize = mesh->indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+	if (mesh->indices.size() != mesh->indexCount * indexSize) return false;
+
+	for (int i = 0; i < mesh->submeshes.size(); i++)
+	{
+		Submesh& submesh = mesh->submeshes[i];
+		if (submesh.baseVertex < 0 || submesh.vertexCount < 0 || submesh.material < 0) return false;
+		if ((size_t)submesh.baseVertex + submesh.vertexCount > vertexCount) return false;
+		if ((size_t)submesh.firstIndex + submesh.indexCount > mesh->indexCount) return false;
+		for (unsigned int j = submesh.firstIndex; j < submesh.firstIndex + submesh.indexCount; j++)
+		{
+			unsigned int index = indexSize == sizeof(unsigned short) ? ((unsigned short*)mesh->indices.data())[j] : ((unsigned int*)mesh->indices.data())[j];
+			if (index >= submesh.vertexCount) return false;
+		}
+	}
+	return true;
+}
+
+// Largest bone id with a weight, -1 for meshes without a skin
+static int GetMaxBoneId(PackedMesh* mesh)
+{
+	int maxBoneId = -1;
+	if (mesh->skin.empty()) return maxBoneId;
+	for (int i = 0; i < mesh->positions.size(); i++)
+	{
+		int boneIds[MAX_BONE_INFLUENCE];
+		float weights[MAX_BONE_INFLUENCE];
+		UnpackSkin(mesh->skin.data(), mesh->skinIndexBits, mesh->skinWeightBits, i, boneIds, weights);
+		for (int k = 0; k < MAX_BONE_INFLUENCE && weights[k] > 0.0f; k++)
+		{
+			maxBoneId = std::max(maxBoneId, boneIds[k]);
+		}
+	}
+	return maxBoneId;
+}
+
+// A key of 0 accepts any cache, for sources that are not shipped
+static bool DeserializeAsset(const char* data, size_t size, unsigned long long key, ImportedAsset* asset)
+{
+	AssetReader reader = { data, size, 0, true };
+	AssetHeader header = {};
+	if (!ReadValue(&reader, header) || header.magic != ASSET_MAGIC || header.version != ASSET_VERSION) return false;
+	if (key && header.key != key) return false;
+
+	*asset = {};
+	PackedMesh& mesh = asset->mesh;
+	ReadArray(&reader, mesh.positions);
+	ReadArray(&reader, mesh.attributes);
+	ReadArray(&reader, mesh.colors);
+	ReadArray(&reader, mesh.skin);
+	ReadValue(&reader, mesh.skinIndexBits);
+	ReadValue(&reader, mesh.skinWeightBits);
+	ReadArray(&reader, mesh.indices);
+	ReadValue(&reader, mesh.indexCount);
+	ReadValue(&reader, mesh.indexType);
+	ReadArray(&reader, mesh.submeshes);
+	ReadValue(&reader, mesh.boundsCenter);
+	ReadValue(&reader, mesh.boundsRadius);
+	reader.valid = reader.valid && IsPackedMeshValid(&mesh);
+
+	int boneCount = -1;
+	ReadValue(&reader, boneCount);
+	if (boneCount >= 0)
+	{
+		asset->skeleton = std::make_shared<Skeleton>();
+		Skeleton* skeleton = asset->skeleton.get();
+		skeleton->count = boneCount;
+		for (int i = 0; i < boneCount && reader.valid; i++)
+		{
+			std::string name;
+			ReadString(&reader, name);
+			skeleton->names.push_back(name);
+		}
+		ReadArray(&reader, skeleton->parents);
+		ReadArray(&reader, skeleton->offsets);
+		ReadArray(&reader, skeleton->bindTransforms);
+		ReadArray(&reader, skeleton->bindPositions);
+		ReadArray(&reader, skeleton->bindRotations);
+		ReadArray(&reader, skeleton->bindScales);
+		std::vector<unsigned char> detailBones;
+		ReadArray(&reader, detailBones);
+		skeleton->detailBones.assign(detailBones.begin(), detailBones.end());
+
+		bool complete = skeleton->parents.size() == boneCount && skeleton->offsets.size() == boneCount && skeleton->bindTransforms.size() == boneCount
+			&& skeleton->bindPositions.size() == boneCount && skeleton->bindRotations.size() == boneCount && skeleton->bindScales.size() == boneCount
+			&& skeleton->detailBones.size() == boneCount;
+		for (int i = 0; i < boneCount && complete; i++)
+		{
+			complete = skeleton->parents[i] >= -1 && skeleton->parents[i] < i;
+		}
+		reader.valid = reader.valid && complete;
+	}
+	reader.valid = reader.valid && GetMaxBoneId(&mesh) < std::max(boneCount, 0);
+
+	unsigned int animationCount = 0;
+	ReadValue(&reader, animationCount);
+	for (unsigned int i = 0; i < animationCount && reader.valid; i++)
+	{
+		Animation animation = {};
+		ReadString(&reader, animation.name);
+		ReadValue(&reader, animation.duration);
+		ReadValue(&reader, animation.ticksPersecond);
+		ReadValue(&reader, animation.globalInverseTransform);
+		int trackCount = -1;
+		ReadValue(&reader, trackCount);
+		if (trackCount >= 0)
+		{
+			// compiled against the skeleton read above
+			reader.valid = reader.valid && asset->skeleton && trackCount == asset->skeleton->count;
+			animation.tracks.resize(reader.valid ? trackCount : 0);
+			for (int j = 0; j < animation.tracks.size() && reader.valid; j++)
+			{
+				ReadTrack(&reader, animation.tracks[j]);
+			}
+			animation.skeleton = asset->skeleton;
+			animation.boneCount = trackCount;
+			asset->animations.push_back(animation);
+			continue;
+		}
+		unsigned int channelCount = 0;
+		ReadValue(&reader, channelCount);
+		for (unsigned int j = 0; j < channelCount && reader.valid; j++)
+		{
+			std::string name;
+			ReadString(&reader, name);
+			ReadTrack(&reader, animation.boneTransforms[name]);
+		}
+		asset->animations.push_back(animation);
+	}
+
+	if (!reader.valid || reader.offset != reader.size)
+	{
+		*asset = {};
+		return false;
+	}
+	return true;
+}
+
+// Import through Assimp, the slow path the cache replaces. The mesh
+// conversion runs in parallel on jobSystem when there is one.
+static bool ImportAsset(const std::string& sourcePath, ImportedAsset* asset, ImportProfile profile, JobSystem* jobSystem = nullptr)
+{
+	Assimp::Importer importer;
+	importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, GetRemovedComponents(profile));
+	const aiScene* scene = importer.ReadFile(sourcePath, GetAssetImportFlags(profile));
+	if (!scene)
+	{
+		std::cout << "Failed to import " << sourcePath << ": " << importer.GetErrorString() << std::endl;
+		return false;
+	}
+
+	*asset = {};
+	if (profile.contents == ASSET_IMPORT_ANIMATIONS)
+	{
+		// the channels name their nodes, so the meshes and bones are never read
+		asset->animations = ReadAnimations(scene);
+		return true;
+	}
+
+	MeshData meshData = LoadSceneMeshData(scene, jobSystem);
+	std::cout << "Imported " << scene->mNumMeshes << " meshes, " << meshData.vertices.size() << " vertices" << std::endl;
+	bool hasBones = false;
+	for (int i = 0; i < scene->mNumMeshes; i++)
+	{
+		hasBones = hasBones || scene->mMeshes[i]->mNumBones > 0;
+	}
+	if (hasBones)
+	{
+		asset->skeleton = std::make_shared<Skeleton>();
+		LoadBoneData(scene, &meshData, asset->skeleton.get(), jobSystem);
+	}
+	OptimizeMesh(&meshData);
+	asset->mesh = PackMesh(&meshData);
+	asset->animations = ReadAnimations(scene);
+	if (asset->skeleton) BindAnimations(asset->animations, asset->skeleton);
+	return true;
+}
+
+// Written next to the final path first so a crash never leaves half a cache
+static bool WriteAssetCache(const std::string& cachePath, const std::vector<char>& data)
+{
+	std::string tempPath = cachePath + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+		{
+			std::cout << "Failed to write " << cachePath << std::endl;
+			return false;
+		}
+		file.write(data.data(), data.size());
+		if (!file.good())
+		{
+			std::cout << "Failed to write " << cachePath << std::endl;
+			return false;
+		}
+	}
+	std::error_code error;
+	std::filesystem::rename(tempPath, cachePath, error);
+	if (error)
+	{
+		std::cout << "Failed to write " << cachePath << ": " << error.message() << std::endl;
+		std::filesystem::remove(tempPath, error);
+		return false;
+	}
+	return true;
+}
+
+// Import sourcePath and write its cache whether or not one is up to date
+static bool CompileAsset(const std::string& sourcePath, ImportedAsset* asset, ImportProfile profile = fullImportProfile, JobSystem* jobSystem = nullptr)
+{
+	unsigned long long key = GetAssetKey(sourcePath, profile);
+	if (!key)
+	{
+		std::cout << "Failed to read " << sourcePath << std::endl;
+		return false;
+	}
+	if (!ImportAsset(sourcePath, asset, profile, jobSystem)) return false;
+	return WriteAssetCache(GetAssetCachePath(sourcePath, profile), SerializeAsset(asset, key));
+}
+
+// Load sourcePath from its cache, compiling it when the cache is missing or stale
+static bool LoadAsset(const std::string& sourcePath, ImportedAsset* asset, ImportProfile profile = fullImportProfile, JobSystem* jobSystem = nullptr)
+{
+	std::string cachePath = GetAssetCachePath(sourcePath, profile);
+	unsigned long long sourceHash = HashFile(sourcePath);
+	unsigned long long key = GetAssetKey(sourceHash, profile);
+	MappedFile cache;
+	if (MapFile(cachePath, &cache))
+	{
+		bool loaded = DeserializeAsset(cache.data, cache.size, key, asset);
+		UnmapFile(&cache);
+		if (loaded)
+		{
+			asset->sourceHash = sourceHash;
+			return true;
+		}
+		// stale or damaged, either way the source is imported again
+		std::cout << cachePath << " is out of date or damaged" << std::endl;
+	}
+
+	if (!key)
+	{
+		std::cout << "Failed to read " << sourcePath << std::endl;
+		return false;
+	}
+	if (!ImportAsset(sourcePath, asset, profile, jobSystem)) return false;
+	asset->sourceHash = sourceHash;
+	// a failed write still leaves the imported asset usable
+	WriteAssetCache(cachePath, SerializeAsset(asset, key));
+	return true;
+}
+
+// Asset compiler entry point, see EntryPoint.cpp
+static bool CompileAssets(const std::vector<std::string>& sourcePaths, ImportProfile profile = fullImportProfile, JobSystem* jobSystem = nullptr)
+{
+	bool compiled = true;
+	for (int i = 0; i < sourcePaths.size(); i++)
+	{
+		ImportedAsset asset = {};
+		bool ok = CompileAsset(sourcePaths[i], &asset, profile, jobSystem);
+		std::cout << (ok ? "Compiled " : "Failed ") << sourcePaths[i] << std::endl;
+		compiled = compiled && ok;
+	}
+	return compiled;
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <chrono>
+
+// Startup loading in parallel. Imports, mesh conversion and image decoding
+// run as jobs on the job system, every finished job hands a GL upload to the
+// main thread through a queue. The main thread uploads results as they
+// arrive and helps with the remaining jobs meanwhile, so loading takes about
+// as long as the slowest asset instead of the sum of all of them.
+
+// CPU result of one asset waiting for its GL upload
+struct AssetUpload
+{
+	std::string name;
+	double loadSeconds;
+	// runs on the main thread, empty when there is nothing to upload
+	std::function<void()> upload;
+};
+
+struct AssetLoader
+{
+	JobSystem* jobSystem;
+	std::mutex mutex;
+	std::deque<AssetUpload> uploads;
+	// submitted and not uploaded yet, only touched by the main thread
+	int pending;
+	std::chrono::steady_clock::time_point start;
+};
+
+static double GetSecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void InitAssetLoader(AssetLoader* loader, JobSystem* jobSystem)
+{
+	loader->jobSystem = jobSystem;
+	loader->uploads.clear();
+	loader->pending = 0;
+	loader->start = std::chrono::steady_clock::now();
+}
+
+// Run load on a worker, the upload it returns runs in FinishLoading
+static void SubmitLoad(AssetLoader* loader, std::string name, std::function<std::function<void()>()> load)
+{
+	loader->pending++;
+	SubmitJob(loader->jobSystem, [loader, name, load]() {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		std::function<void()> upload = load();
+		double loadSeconds = GetSecondsSince(start);
+
+		std::lock_guard<std::mutex> lock(loader->mutex);
+		loader->uploads.push_back({ name, loadSeconds, std::move(upload) });
+	});
+}
+
+// asset stays owned by the caller and must outlive FinishLoading. upload only
+// runs for assets that loaded, a failed load leaves asset empty.
+static void LoadAssetAsync(AssetLoader* loader, std::string path, ImportedAsset* asset, std::function<void(ImportedAsset*)> upload = nullptr, ImportProfile profile = fullImportProfile)
+{
+	JobSystem* jobSystem = loader->jobSystem;
+	SubmitLoad(loader, path, [path, asset, upload, profile, jobSystem]() -> std::function<void()> {
+		if (!LoadAsset(path, asset, profile, jobSystem))
+		{
+			std::cout << "Failed to load " << path << std::endl;
+			return nullptr;
+		}
+		if (!upload) return nullptr;
+		return [asset, upload]() { upload(asset); };
+	});
+}
+
+// texture is written on the main thread once the image is decoded, the
+// HashFile of the image goes to contentKey when there is one
+static void LoadTextureAsync(AssetLoader* loader, Texture* texture, std::string name, std::string path, unsigned long long* contentKey = nullptr)
+{
+	SubmitLoad(loader, path, [texture, name, path, contentKey]() -> std::function<void()> {
+		if (contentKey) *contentKey = HashFile(path);
+		std::shared_ptr<TextureData> textureData = std::make_shared<TextureData>();
+		DecodeTexture(textureData.get(), path);
+		return [texture, name, textureData]() { UploadTexture(texture, name, textureData.get()); };
+	});
+}
+
+// Upload every result on the main thread and log the time each asset took
+static void FinishLoading(AssetLoader* loader)
+{
+	double loadSeconds = 0.0;
+	while (loader->pending > 0)
+	{
+		AssetUpload upload;
+		bool ready = false;
+		{
+			std::lock_guard<std::mutex> lock(loader->mutex);
+			if (!loader->uploads.empty())
+			{
+				upload = std::move(loader->uploads.front());
+				loader->uploads.pop_front();
+				ready = true;
+			}
+		}
+		if (!ready)
+		{
+			if (!RunNextJob(loader->jobSystem)) std::this_thread::yield();
+			continue;
+		}
+
+		std::chrono::steady_clock::time_point uploadStart = std::chrono::steady_clock::now();
+		if (upload.upload) upload.upload();
+		double uploadSeconds = GetSecondsSince(uploadStart);
+		loader->pending--;
+		loadSeconds += upload.loadSeconds;
+		std::cout << upload.name << ": loaded in " << upload.loadSeconds * 1000.0 << " ms, uploaded in " << uploadSeconds * 1000.0 << " ms" << std::endl;
+	}
+	std::cout << "Assets ready after " << GetSecondsSince(loader->start) * 1000.0 << " ms, " << loadSeconds * 1000.0 << " ms of loading work" << std::endl;
+}
@@ -0,0 +1,165 @@
+#pragma once
+#include <cfloat>
+#include <cstring>
+
+// Import microbenchmark, run with Opengl_boilerplate --benchmark-import
+// <file.dae|file.obj>... It times the mesh conversion and the bone weights
+// of LoadSceneMeshData and GatherBoneWeights against the per vertex code they
+// replaced, kept below as the reference, and checks every path builds the
+// same MeshData.
+
+#define BENCHMARK_RUNS 5
+
+// One LoadMeshData per aiMesh, placed by its node and appended to the merged arrays
+static MeshData LoadSceneMeshDataReference(const aiScene* scene)
+{
+	MeshData meshData = {};
+	std::vector<glm::mat4> transforms = GetMeshTransforms(scene);
+	for (int i = 0; i < scene->mNumMeshes; i++)
+	{
+		MeshData submeshData = LoadMeshData(scene, i);
+		if (transforms[i] != glm::mat4(1.0f)) TransformVertices(submeshData.vertices.data(), 0, submeshData.vertices.size(), transforms[i]);
+		Submesh submesh = submeshData.submeshes[0];
+		submesh.firstIndex = meshData.indices.size();
+		submesh.baseVertex = meshData.vertices.size();
+		meshData.submeshes.push_back(submesh);
+		meshData.vertices.insert(meshData.vertices.end(), submeshData.vertices.begin(), submeshData.vertices.end());
+		meshData.indices.insert(meshData.indices.end(), submeshData.indices.begin(), submeshData.indices.end());
+	}
+	return meshData;
+}
+
+// An influence list per vertex, each sorted on its own
+static void GatherBoneWeightsReference(const aiScene* scene, MeshData* meshData, const std::unordered_map<std::string, int>& boneIds)
+{
+	int meshCount = std::min((int)scene->mNumMeshes, (int)meshData->submeshes.size());
+	std::vector<std::vector<std::pair<float, int>>> influences(meshData->vertices.size());
+	for (int m = 0; m < meshCount; m++)
+	{
+		aiMesh* meshInfo = scene->mMeshes[m];
+		for (int i = 0; i < meshInfo->mNumBones; i++)
+		{
+			aiBone* bone = meshInfo->mBones[i];
+			auto boneId = boneIds.find(bone->mName.C_Str());
+			if (boneId == boneIds.end()) continue;
+			for (int j = 0; j < bone->mNumWeights; j++)
+			{
+				int id = meshData->submeshes[m].baseVertex + bone->mWeights[j].mVertexId;
+				influences[id].push_back({ bone->mWeights[j].mWeight, boneId->second });
+			}
+		}
+	}
+
+	for (int i = 0; i < influences.size(); i++)
+	{
+		std::sort(influences[i].begin(), influences[i].end(), HeavierInfluence);
+		if (influences[i].size() > MAX_BONE_INFLUENCE) influences[i].resize(MAX_BONE_INFLUENCE);
+
+		float total = 0.0f;
+		for (int k = 0; k < influences[i].size(); k++)
+		{
+			total += influences[i][k].first;
+		}
+		for (int k = 0; k < influences[i].size(); k++)
+		{
+			meshData->vertices[i].animated.boneIDs[k] = influences[i][k].second;
+			meshData->vertices[i].animated.weights[k] = total > 0.0f ? influences[i][k].first / total : 0.0f;
+		}
+	}
+}
+
+// Best time of BENCHMARK_RUNS for the conversion and for the weights,
+// jobSystem is ignored by the reference
+static void TimeConversion(const aiScene* scene, const std::unordered_map<std::string, int>& boneIds, bool reference, JobSystem* jobSystem, MeshData* meshData, double* meshSeconds, double* weightSeconds)
+{
+	*meshSeconds = DBL_MAX;
+	*weightSeconds = boneIds.empty() ? 0.0 : DBL_MAX;
+	for (int run = 0; run < BENCHMARK_RUNS; run++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		*meshData = reference ? LoadSceneMeshDataReference(scene) : LoadSceneMeshData(scene, jobSystem);
+		*meshSeconds = std::min(*meshSeconds, GetSecondsSince(start));
+		if (boneIds.empty()) continue;
+
+		start = std::chrono::steady_clock::now();
+		if (reference) GatherBoneWeightsReference(scene, meshData, boneIds);
+		else GatherBoneWeights(scene, meshData, boneIds, jobSystem);
+		*weightSeconds = std::min(*weightSeconds, GetSecondsSince(start));
+	}
+}
+
+// Vertices whose attributes or weights differ, every vertex when the
+// arrays don't line up
+static int CountMismatches(MeshData* a, MeshData* b)
+{
+	if (a->vertices.size() != b->vertices.size() || a->indices != b->indices) return std::max(a->vertices.size(), b->vertices.size());
+
+	int mismatches = 0;
+	for (int i = 0; i < a->vertices.size(); i++)
+	{
+		VertexData& va = a->vertices[i];
+		VertexData& vb = b->vertices[i];
+		bool same = std::memcmp(&va.mesh, &vb.mesh, sizeof(MeshVertex)) == 0;
+		for (int k = 0; k < MAX_BONE_INFLUENCE; k++)
+		{
+			same = same && va.animated.boneIDs[k] == vb.animated.boneIDs[k] && va.animated.weights[k] == vb.animated.weights[k];
+		}
+		mismatches += !same;
+	}
+	return mismatches;
+}
+
+static void PrintTimings(const char* label, double meshSeconds, double weightSeconds)
+{
+	std::cout << "  " << label << ": mesh " << meshSeconds * 1000.0 << " ms, weights " << weightSeconds * 1000.0 << " ms" << std::endl;
+}
+
+static bool BenchmarkImport(const std::vector<std::string>& sourcePaths, JobSystem* jobSystem)
+{
+	bool matched = true;
+	for (int i = 0; i < sourcePaths.size(); i++)
+	{
+		Assimp::Importer importer;
+		const aiScene* scene = importer.ReadFile(sourcePaths[i], ASSET_IMPORT_FLAGS);
+		if (!scene)
+		{
+			std::cout << "Failed to import " << sourcePaths[i] << ": " << importer.GetErrorString() << std::endl;
+			matched = false;
+			continue;
+		}
+
+		std::unordered_map<std::string, int> boneIds = {};
+		Skeleton skeleton = {};
+		for (int m = 0; m < scene->mNumMeshes; m++)
+		{
+			if (scene->mMeshes[m]->mNumBones == 0) continue;
+			LoadSkeleton(scene, &skeleton);
+			boneIds = GetBoneIds(&skeleton);
+			break;
+		}
+
+		MeshData reference = {};
+		MeshData serial = {};
+		MeshData parallel = {};
+		double meshSeconds[3];
+		double weightSeconds[3];
+		TimeConversion(scene, boneIds, true, nullptr, &reference, &meshSeconds[0], &weightSeconds[0]);
+		TimeConversion(scene, boneIds, false, nullptr, &serial, &meshSeconds[1], &weightSeconds[1]);
+		TimeConversion(scene, boneIds, false, jobSystem, &parallel, &meshSeconds[2], &weightSeconds[2]);
+
+		std::cout << sourcePaths[i] << ": " << reference.vertices.size() << " vertices, " << boneIds.size() << " bones, best of " << BENCHMARK_RUNS << std::endl;
+		PrintTimings("per vertex", meshSeconds[0], weightSeconds[0]);
+		PrintTimings("streams, 1 thread", meshSeconds[1], weightSeconds[1]);
+		std::string parallelLabel = "streams, " + std::to_string(jobSystem->count + 1) + " threads";
+		PrintTimings(parallelLabel.c_str(), meshSeconds[2], weightSeconds[2]);
+		std::cout << "  speedup " << (meshSeconds[0] + weightSeconds[0]) / (meshSeconds[2] + weightSeconds[2]) << "x" << std::endl;
+
+		int mismatches = CountMismatches(&reference, &serial) + CountMismatches(&reference, &parallel);
+		if (mismatches)
+		{
+			std::cout << "  " << mismatches << " vertices differ from the per vertex conversion" << std::endl;
+			matched = false;
+		}
+	}
+	return matched;
+}
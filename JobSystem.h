@@ -0,0 +1,165 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <functional>
+
+// Work stealing thread pool. Every thread owns a queue, it pops its own jobs
+// from the back and steals from the front of the others when it runs dry.
+// Queue 0 belongs to the main thread, which helps out while it waits.
+
+typedef std::function<void()> Job;
+
+struct JobQueue
+{
+	std::mutex mutex;
+	std::deque<Job> jobs;
+};
+
+struct JobSystem
+{
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<JobQueue>> queues;
+	std::atomic<int> queued;
+	std::atomic<bool> running;
+	std::mutex wakeMutex;
+	std::condition_variable wake;
+	int count;
+};
+
+// inline so every translation unit sees the same per-thread index
+inline thread_local int jobQueueIndex = 0;
+
+static bool PopJob(JobSystem* jobSystem, Job& job)
+{
+	int queueCount = jobSystem->queues.size();
+	for (int i = 0; i < queueCount; i++)
+	{
+		int index = (jobQueueIndex + i) % queueCount;
+		JobQueue* queue = jobSystem->queues[index].get();
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		if (queue->jobs.empty()) continue;
+		if (i == 0)
+		{
+			job = std::move(queue->jobs.back());
+			queue->jobs.pop_back();
+		}
+		else
+		{
+			job = std::move(queue->jobs.front());
+			queue->jobs.pop_front();
+		}
+		jobSystem->queued--;
+		return true;
+	}
+	return false;
+}
+
+static bool RunNextJob(JobSystem* jobSystem)
+{
+	Job job;
+	if (!PopJob(jobSystem, job)) return false;
+	job();
+	return true;
+}
+
+static void SubmitJob(JobSystem* jobSystem, Job job)
+{
+	JobQueue* queue = jobSystem->queues[jobQueueIndex].get();
+	{
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		queue->jobs.push_back(std::move(job));
+	}
+	{
+		std::lock_guard<std::mutex> lock(jobSystem->wakeMutex);
+		jobSystem->queued++;
+	}
+	jobSystem->wake.notify_one();
+}
+
+static void WorkerLoop(JobSystem* jobSystem, int index)
+{
+	jobQueueIndex = index;
+	while (jobSystem->running)
+	{
+		if (RunNextJob(jobSystem)) continue;
+		std::unique_lock<std::mutex> lock(jobSystem->wakeMutex);
+		jobSystem->wake.wait(lock, [jobSystem]() {
+			return jobSystem->queued > 0 || !jobSystem->running;
+		});
+	}
+}
+
+// threadCount <= 0 uses one worker per spare hardware thread
+static void InitJobSystem(JobSystem* jobSystem, int threadCount = 0)
+{
+	if (threadCount <= 0)
+	{
+		threadCount = (int)std::thread::hardware_concurrency() - 1;
+	}
+	threadCount = std::max(threadCount, 0);
+
+	jobSystem->queued = 0;
+	jobSystem->running = true;
+	jobSystem->count = threadCount;
+	for (int i = 0; i < threadCount + 1; i++)
+	{
+		jobSystem->queues.push_back(std::make_unique<JobQueue>());
+	}
+	for (int i = 0; i < threadCount; i++)
+	{
+		jobSystem->workers.push_back(std::thread(WorkerLoop, jobSystem, i + 1));
+	}
+}
+
+static void DestroyJobSystem(JobSystem* jobSystem)
+{
+	{
+		std::lock_guard<std::mutex> lock(jobSystem->wakeMutex);
+		jobSystem->running = false;
+	}
+	jobSystem->wake.notify_all();
+	for (int i = 0; i < jobSystem->workers.size(); i++)
+	{
+		jobSystem->workers[i].join();
+	}
+	jobSystem->workers.clear();
+	jobSystem->queues.clear();
+	jobSystem->count = 0;
+}
+
+// Split [0, count) into ranges of at most grainSize and run func(begin, end)
+// on every range, returns once all of them are done.
+static void ParallelFor(JobSystem* jobSystem, int count, int grainSize, const std::function<void(int, int)>& func)
+{
+	if (count <= 0) return;
+	grainSize = std::max(grainSize, 1);
+	if (!jobSystem || jobSystem->count == 0 || count <= grainSize)
+	{
+		func(0, count);
+		return;
+	}
+
+	int remaining = (count + grainSize - 1) / grainSize;
+	std::mutex doneMutex;
+	std::condition_variable done;
+	for (int begin = 0; begin < count; begin += grainSize)
+	{
+		int end = std::min(begin + grainSize, count);
+		SubmitJob(jobSystem, [&func, &remaining, &doneMutex, &done, begin, end]() {
+			func(begin, end);
+			// notify while holding the lock, the waiter owns done and may return right after
+			std::lock_guard<std::mutex> lock(doneMutex);
+			if (--remaining == 0) done.notify_all();
+		});
+	}
+
+	// help with queued jobs, then sleep until the ranges still running elsewhere finish
+	while (RunNextJob(jobSystem))
+	{
+	}
+	std::unique_lock<std::mutex> lock(doneMutex);
+	done.wait(lock, [&remaining]() { return remaining == 0; });
+}
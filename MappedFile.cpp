@@ -0,0 +1,83 @@
+#include <string>
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+
+bool MapFile(const std::string& path, MappedFile* file)
+{
+	*file = {};
+	HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (handle == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0)
+	{
+		CloseHandle(handle);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping)
+	{
+		CloseHandle(handle);
+		return false;
+	}
+	void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!data)
+	{
+		CloseHandle(mapping);
+		CloseHandle(handle);
+		return false;
+	}
+
+	file->data = (const char*)data;
+	file->size = (size_t)size.QuadPart;
+	file->handle = handle;
+	file->mapping = mapping;
+	return true;
+}
+
+void UnmapFile(MappedFile* file)
+{
+	if (file->data) UnmapViewOfFile(file->data);
+	if (file->mapping) CloseHandle(file->mapping);
+	if (file->handle) CloseHandle(file->handle);
+	*file = {};
+}
+
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool MapFile(const std::string& path, MappedFile* file)
+{
+	*file = {};
+	int descriptor = open(path.c_str(), O_RDONLY);
+	if (descriptor < 0) return false;
+
+	struct stat info;
+	if (fstat(descriptor, &info) != 0 || info.st_size == 0)
+	{
+		close(descriptor);
+		return false;
+	}
+	void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	// the mapping stays valid without the descriptor
+	close(descriptor);
+	if (data == MAP_FAILED) return false;
+
+	file->data = (const char*)data;
+	file->size = (size_t)info.st_size;
+	return true;
+}
+
+void UnmapFile(MappedFile* file)
+{
+	if (file->data) munmap((void*)file->data, file->size);
+	*file = {};
+}
+#endif
@@ -0,0 +1,14 @@
+#pragma once
+
+// Read-only view of a whole file mapped into memory. The platform code lives
+// in MappedFile.cpp so <windows.h> stays out of the single header build.
+struct MappedFile
+{
+	const char* data;
+	size_t size;
+	void* handle;
+	void* mapping;
+};
+
+bool MapFile(const std::string& path, MappedFile* file);
+void UnmapFile(MappedFile* file);
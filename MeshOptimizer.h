@@ -0,0 +1,272 @@
+#pragma once
+
+// Import stage that reorders triangles for the post-transform vertex cache
+// (Tipsify, Sander et al. 2007), sorts the resulting clusters to reduce
+// overdraw and finally reorders vertices in first use order for fetch locality.
+// Every influence bucket of every submesh is optimized on its own so the
+// ranges stay intact.
+
+// FIFO size used both for the reordering and for the reported statistics
+#define VERTEX_CACHE_SIZE 16
+
+struct VertexCacheStats
+{
+	// transformed vertices per triangle
+	float acmr;
+	// transformed vertices per vertex
+	float atvr;
+};
+
+// Vertices a FIFO cache transforms for the given indices
+static int GetTransformedVertices(const unsigned int* indices, int count, int cacheSize)
+{
+	std::vector<int> cache(cacheSize, -1);
+	int head = 0;
+	int transformed = 0;
+	for (int i = 0; i < count; i++)
+	{
+		int vertex = indices[i];
+		if (std::find(cache.begin(), cache.end(), vertex) != cache.end()) continue;
+		cache[head] = vertex;
+		head = (head + 1) % cacheSize;
+		transformed++;
+	}
+	return transformed;
+}
+
+// Submeshes are separate draws, the cache starts empty for each
+static VertexCacheStats GetVertexCacheStats(MeshData* meshData, int cacheSize = VERTEX_CACHE_SIZE)
+{
+	int transformed = 0;
+	for (int i = 0; i < meshData->submeshes.size(); i++)
+	{
+		Submesh& submesh = meshData->submeshes[i];
+		transformed += GetTransformedVertices(meshData->indices.data() + submesh.firstIndex, submesh.indexCount, cacheSize);
+	}
+
+	VertexCacheStats stats = {};
+	stats.acmr = meshData->indices.size() ? transformed / (meshData->indices.size() / 3.0f) : 0.0f;
+	stats.atvr = meshData->vertices.size() ? transformed / (float)meshData->vertices.size() : 0.0f;
+	return stats;
+}
+
+// Triangles of a Tipsify cluster, fanned around vertices that were in cache
+struct TriangleCluster
+{
+	int first;
+	int count;
+	float sortKey;
+};
+
+// Reorder the triangles in [first, first + count) of indices. Clusters start
+// wherever Tipsify had to jump to a vertex that was no longer in cache.
+static std::vector<TriangleCluster> Tipsify(unsigned int* indices, int count, int vertexCount, int cacheSize)
+{
+	int triangleCount = count / 3;
+	std::vector<TriangleCluster> clusters;
+	if (!triangleCount) return clusters;
+
+	// triangles using each vertex
+	std::vector<int> liveTriangles(vertexCount, 0);
+	for (int i = 0; i < count; i++)
+	{
+		liveTriangles[indices[i]]++;
+	}
+	std::vector<int> adjacencyOffsets(vertexCount + 1, 0);
+	for (int i = 0; i < vertexCount; i++)
+	{
+		adjacencyOffsets[i + 1] = adjacencyOffsets[i] + liveTriangles[i];
+	}
+	std::vector<int> adjacency(count);
+	std::vector<int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (int i = 0; i < count; i++)
+	{
+		adjacency[fill[indices[i]]++] = i / 3;
+	}
+
+	std::vector<int> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<int> deadEnds;
+	std::vector<unsigned int> output;
+	output.reserve(count);
+
+	int fanning = indices[0];
+	int time = cacheSize + 1;
+	int cursor = 0;
+	clusters.push_back({ 0, 0, 0.0f });
+	while (fanning >= 0)
+	{
+		std::vector<int> candidates;
+		for (int i = adjacencyOffsets[fanning]; i < adjacencyOffsets[fanning + 1]; i++)
+		{
+			int triangle = adjacency[i];
+			if (emitted[triangle]) continue;
+			emitted[triangle] = true;
+			for (int k = 0; k < 3; k++)
+			{
+				int vertex = indices[triangle * 3 + k];
+				output.push_back(vertex);
+				deadEnds.push_back(vertex);
+				candidates.push_back(vertex);
+				liveTriangles[vertex]--;
+				if (time - cacheTime[vertex] > cacheSize)
+				{
+					cacheTime[vertex] = time++;
+				}
+			}
+		}
+
+		// prefer the candidate that stays in cache longest and still fits its fan
+		int next = -1;
+		int bestPriority = -1;
+		for (int i = 0; i < candidates.size(); i++)
+		{
+			int vertex = candidates[i];
+			if (liveTriangles[vertex] <= 0) continue;
+			int priority = 0;
+			if (time - cacheTime[vertex] + 2 * liveTriangles[vertex] <= cacheSize)
+			{
+				priority = time - cacheTime[vertex];
+			}
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				next = vertex;
+			}
+		}
+
+		if (next == -1)
+		{
+			// dead end, the next fan starts a new cluster
+			while (!deadEnds.empty() && next == -1)
+			{
+				int vertex = deadEnds.back();
+				deadEnds.pop_back();
+				if (liveTriangles[vertex] > 0) next = vertex;
+			}
+			while (next == -1 && cursor < vertexCount)
+			{
+				if (liveTriangles[cursor] > 0) next = cursor;
+				cursor++;
+			}
+			clusters.back().count = output.size() - clusters.back().first;
+			if (next != -1) clusters.push_back({ (int)output.size(), 0, 0.0f });
+		}
+		fanning = next;
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+	return clusters;
+}
+
+// Sort clusters so the ones facing away from the mesh center, which tend to
+// occlude the rest, are drawn first
+static void SortClustersForOverdraw(unsigned int* indices, std::vector<TriangleCluster>& clusters, const VertexData* vertices, glm::vec3 meshCenter)
+{
+	for (int i = 0; i < clusters.size(); i++)
+	{
+		glm::vec3 centroid = glm::vec3(0.0f);
+		glm::vec3 normal = glm::vec3(0.0f);
+		float area = 0.0f;
+		for (int t = clusters[i].first; t < clusters[i].first + clusters[i].count; t += 3)
+		{
+			glm::vec3 a = vertices[indices[t]].mesh.position;
+			glm::vec3 b = vertices[indices[t + 1]].mesh.position;
+			glm::vec3 c = vertices[indices[t + 2]].mesh.position;
+			glm::vec3 cross = glm::cross(b - a, c - a);
+			float triangleArea = glm::length(cross) * 0.5f;
+			centroid += (a + b + c) / 3.0f * triangleArea;
+			normal += cross;
+			area += triangleArea;
+		}
+		if (area > 0.0f) centroid /= area;
+		float normalLength = glm::length(normal);
+		clusters[i].sortKey = normalLength > 0.0f ? glm::dot(centroid - meshCenter, normal / normalLength) : 0.0f;
+	}
+
+	std::vector<TriangleCluster> sorted = clusters;
+	std::stable_sort(sorted.begin(), sorted.end(), [](const TriangleCluster& a, const TriangleCluster& b) { return a.sortKey > b.sortKey; });
+
+	std::vector<unsigned int> output;
+	for (int i = 0; i < sorted.size(); i++)
+	{
+		output.insert(output.end(), indices + sorted[i].first, indices + sorted[i].first + sorted[i].count);
+	}
+	std::copy(output.begin(), output.end(), indices + clusters.front().first);
+}
+
+// Renumber the vertices of a submesh in the order its indices first use them
+static void ReorderVertices(MeshData* meshData, Submesh& submesh)
+{
+	VertexData* source = meshData->vertices.data() + submesh.baseVertex;
+	std::vector<int> remap(submesh.vertexCount, -1);
+	std::vector<VertexData> vertices;
+	vertices.reserve(submesh.vertexCount);
+	for (unsigned int i = submesh.firstIndex; i < submesh.firstIndex + submesh.indexCount; i++)
+	{
+		int vertex = meshData->indices[i];
+		if (remap[vertex] == -1)
+		{
+			remap[vertex] = vertices.size();
+			vertices.push_back(source[vertex]);
+		}
+		meshData->indices[i] = remap[vertex];
+	}
+	// unreferenced vertices keep their relative order at the end
+	for (int i = 0; i < submesh.vertexCount; i++)
+	{
+		if (remap[i] == -1) vertices.push_back(source[i]);
+	}
+	std::copy(vertices.begin(), vertices.end(), source);
+}
+
+static void OptimizeMesh(MeshData* meshData)
+{
+	if (meshData->indices.empty()) return;
+	InitSubmeshes(meshData);
+	VertexCacheStats before = GetVertexCacheStats(meshData);
+
+	for (int s = 0; s < meshData->submeshes.size(); s++)
+	{
+		Submesh& submesh = meshData->submeshes[s];
+		const VertexData* vertices = meshData->vertices.data() + submesh.baseVertex;
+		glm::vec3 center = glm::vec3(0.0f);
+		for (int i = 0; i < submesh.vertexCount; i++)
+		{
+			center += vertices[i].mesh.position;
+		}
+		if (submesh.vertexCount) center /= (float)submesh.vertexCount;
+
+		// submeshes that were never bucketed are one range
+		unsigned int bucketed = 0;
+		for (int i = 0; i < INFLUENCE_BUCKET_COUNT; i++)
+		{
+			bucketed += submesh.influenceCounts[i];
+		}
+		std::vector<unsigned int> ranges;
+		if (bucketed == submesh.indexCount)
+		{
+			ranges.assign(submesh.influenceCounts, submesh.influenceCounts + INFLUENCE_BUCKET_COUNT);
+		}
+		else
+		{
+			ranges.push_back(submesh.indexCount);
+		}
+
+		unsigned int first = submesh.firstIndex;
+		for (int i = 0; i < ranges.size(); i++)
+		{
+			unsigned int* indices = meshData->indices.data() + first;
+			std::vector<TriangleCluster> clusters = Tipsify(indices, ranges[i], submesh.vertexCount, VERTEX_CACHE_SIZE);
+			if (!clusters.empty())
+			{
+				SortClustersForOverdraw(indices, clusters, vertices, center);
+			}
+			first += ranges[i];
+		}
+		ReorderVertices(meshData, submesh);
+	}
+
+	VertexCacheStats after = GetVertexCacheStats(meshData);
+	std::cout << "Vertex cache ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+}
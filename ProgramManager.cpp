@@ -10,8 +10,10 @@ int ProgramManager::Init()
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+    // the resources load on the job system
+    InitJobSystem(&jobSystem);
     resource = {};
-    InitResources(&resource, &window);
+    InitResources(&resource, &window, &jobSystem);
 
     scene = {};
     InitScene(&scene, &resource, &window);
@@ -58,6 +60,11 @@ void ProgramManager::Update()
 
 void ProgramManager::Destroy()
 {
+    DestroyJobSystem(&jobSystem);
+    for (int i = 0; i < scene.models.count; i++)
+    {
+        DestroySkinnedMesh(&scene.models.skinnedMeshes[i]);
+    }
     DestroyResources(&resource, &window);
     glfwTerminate();
     DestroyGUI();
@@ -81,8 +88,9 @@ void ProgramManager::CaptureAnimationFrames(int numFrames)
 
         if (animation)
         {           
-            timeIncrement = animation->duration / (float)(numFrames);
-            std::pair<glm::vec3, glm::vec3> volume = GetAnimationBoundingVolume(mesh, animation, modelMatrix, frames);
+            // frameTime is elapsed seconds, converted to ticks when the poses are sampled
+            timeIncrement = animation->duration / GetTicksPerSecond(animation) / (float)(numFrames);
+            std::pair<glm::vec3, glm::vec3> volume = GetAnimationBoundingVolume(mesh, animation, modelMatrix, frames, preSkinning ? &resource.skinningProgram : nullptr, &resource.bonePalette);
             SnapCameraToBoundingVolume(volume);
         }
         else 
@@ -108,7 +116,8 @@ void ProgramManager::CaptureAnimationFrames(int numFrames)
         {
             UpdateScene(&resource.shaders[i], scene, frameTime);
         }
-        UpdateModels(scene.models, frameTime);
+        EvaluateModelPoses(scene.models, scene.animationInstances, frameTime, &jobSystem);
+        UpdateModels(scene.models, scene.animationInstances, frameTime, &resource.bonePalette, preSkinning ? &resource.skinningProgram : nullptr);
         RenderModels(scene.models);
         //RenderLigths(&resource.shaders[COLOR_SHADER], resource, scene);
 
@@ -141,7 +150,8 @@ void ProgramManager::CaptureAnimationFrames(int numFrames)
         }
         frameTime += timeIncrement;
     }
-    AddSpriteAnimation(&resource.spriteAnimations, spriteTextures, outputWidth, outputHeight, resource.animations[selectedAnimation].duration);
+    Animation* spriteClip = &resource.animations[selectedAnimation];
+    AddSpriteAnimation(&resource.spriteAnimations, spriteTextures, outputWidth, outputHeight, spriteClip->duration / GetTicksPerSecond(spriteClip));
 }
 
 void ProgramManager::RenderBoundingVolume()
@@ -200,7 +210,8 @@ void ProgramManager::RenderSceneWindow()
         {
             UpdateScene(&resource.shaders[i], scene, elapsedTime);
         }
-        UpdateModels(scene.models, elapsedTime);
+        EvaluateModelPoses(scene.models, scene.animationInstances, elapsedTime, &jobSystem, &scene.camera, &scene.animationLOD);
+        UpdateModels(scene.models, scene.animationInstances, elapsedTime, &resource.bonePalette, preSkinning ? &resource.skinningProgram : nullptr);
         RenderModels(scene.models);
 
         //RenderLigths(&resource.shaders[UNSHADED_SHADER], resource, scene);
@@ -292,7 +303,7 @@ void ProgramManager::RenderSidePannel()
         glm::mat4 modelMatrix = GetModelMatrix(scene.models.positions[selectedModel], scene.models.rotations[selectedModel], scene.models.scales[selectedModel]);
         if (scene.models.animations[selectedModel])
         {
-            std::pair<glm::vec3, glm::vec3> volume = GetAnimationBoundingVolume(scene.models.meshes[selectedModel], scene.models.animations[selectedModel], modelMatrix, frames);
+            std::pair<glm::vec3, glm::vec3> volume = GetAnimationBoundingVolume(scene.models.meshes[selectedModel], scene.models.animations[selectedModel], modelMatrix, frames, preSkinning ? &resource.skinningProgram : nullptr, &resource.bonePalette);
             SnapCameraToBoundingVolume(volume);
         }
         else {
@@ -301,6 +312,28 @@ void ProgramManager::RenderSidePannel()
         }
     }
 
+    if (scene.models.animations[selectedModel])
+    {
+        bool baked = scene.models.baked[selectedModel];
+        ImGui::Checkbox("Baked palette", &baked);
+        scene.models.baked[selectedModel] = baked;
+    }
+
+    const char* paletteFormats[] = { "mat4", "3x4", "Dual quaternion" };
+    ImGui::Combo("Palette format", &resource.bonePalette.format, paletteFormats, 3);
+    ImGui::Checkbox("Compute skinning", &preSkinning);
+
+    ImGui::Checkbox("Animation LOD", &scene.animationLOD.enabled);
+    if (scene.animationLOD.enabled)
+    {
+        ImGui::Text("Full: %d Half: %d Quarter: %d", scene.animationLOD.counts[ANIMATION_LOD_FULL], scene.animationLOD.counts[ANIMATION_LOD_HALF], scene.animationLOD.counts[ANIMATION_LOD_QUARTER]);
+    }
+
+    if (ImGui::Checkbox("Compress animations", &resource.animationCompression.settings.enabled))
+    {
+        CompressAnimations(resource.animations, &resource.animationCompression);
+    }
+
 
     std::vector<std::string> materialNames = MapArray<Material, std::string>(resource.materials, [](Material material)
         {
@@ -324,6 +357,23 @@ void ProgramManager::RenderSidePannel()
 
     scene.models.materials[selectedModel] = &resource.materials[selectedMaterial];
 
+    // meshes imported with several materials pick one per slot, 0 keeps the model's
+    Mesh* selectedMesh = scene.models.meshes[selectedModel];
+    if (selectedMesh->materialCount > 1)
+    {
+        std::vector<std::string> slotNames = materialNames;
+        slotNames.insert(slotNames.begin(), "(Model material)");
+        std::vector<Material*>& slotMaterials = scene.models.slotMaterials[selectedModel];
+        slotMaterials.resize(selectedMesh->materialCount, nullptr);
+        for (int slot = 0; slot < selectedMesh->materialCount; slot++)
+        {
+            int selectedSlotMaterial = slotMaterials[slot] ? slotMaterials[slot] - resource.materials.data() + 1 : 0;
+            std::string label = "Slot " + std::to_string(slot);
+            ImGui::Combo(label.c_str(), &selectedSlotMaterial, VectorOfStringGetter, static_cast<void*>(&slotNames), slotNames.size());
+            slotMaterials[slot] = selectedSlotMaterial ? &resource.materials[selectedSlotMaterial - 1] : nullptr;
+        }
+    }
+
     ImGui::Spacing();
     if (resource.materials[selectedMaterial].type == 1)
     {
@@ -344,7 +394,7 @@ void ProgramManager::RenderSidePannel()
         glm::mat4 modelMatrix = GetModelMatrix(scene.models.positions[selectedModel], scene.models.rotations[selectedModel], scene.models.scales[selectedModel]);
         if (scene.models.animations[selectedModel])
         {
-            std::pair<glm::vec3, glm::vec3> volume = GetAnimationBoundingVolume(scene.models.meshes[selectedModel], scene.models.animations[selectedModel], modelMatrix, frames);
+            std::pair<glm::vec3, glm::vec3> volume = GetAnimationBoundingVolume(scene.models.meshes[selectedModel], scene.models.animations[selectedModel], modelMatrix, frames, preSkinning ? &resource.skinningProgram : nullptr, &resource.bonePalette);
             SnapCameraToBoundingVolume(volume);
         }
         else {
@@ -397,6 +447,16 @@ void ProgramManager::SnapCameraToBoundingVolume(std::pair<glm::vec3, glm::vec3>
 void ProgramManager::RenderResourcePannel()
 {
     ImGui::Begin("Resources");
+
+    // repeated loads hit the resource cache
+    if (ImGui::TreeNodeEx("Cache"))
+    {
+        for (int i = 0; i < CACHED_KIND_COUNT; i++)
+        {
+            ImGui::Text("%s: %d hits, %d misses", cachedKindNames[i], resource.cache.hits[i], resource.cache.misses[i]);
+        }
+        ImGui::TreePop();
+    }
     
     // load mesh
     {
@@ -406,7 +466,13 @@ void ProgramManager::RenderResourcePannel()
             {
                 if (ImGui::TreeNodeEx(AppendNextUIID(resource.meshes[i].name).c_str()))
                 {
-
+                    CachedResource* cached = GetCached(&resource.cache, CACHED_MESH, i);
+                    ImGui::Text("References: %d", cached ? cached->references : 1);
+                    // the startup meshes stay, the output quad draws every frame
+                    if (i > QUAD_MESH && ImGui::Button(("Remove" + GetNextUIID()).c_str()))
+                    {
+                        if (RemoveSceneMesh(&scene, &resource, i)) i--;
+                    }
                     ImGui::TreePop();
                 }
             }
@@ -448,15 +514,8 @@ void ProgramManager::RenderResourcePannel()
             }
             if (ImGui::Button("Add") && meshName.size() != 0)
             {
-                MeshData meshData = {};
-
-                //MeshData meshData = {};
-                if (LoadMeshData(meshPathName, &meshData))
-                {
-                    Mesh mesh = {};
-                    InitMesh(meshName, &mesh, &meshData);
-                    resource.meshes.push_back(mesh);
-                }
+                // a mesh loaded before comes back as its existing slot
+                AcquireMesh(&resource, meshName, meshPathName, GetMaterialImportProfile(&resource));
 
                 loadingMesh = false;
                 meshName = "";
@@ -474,13 +533,14 @@ void ProgramManager::RenderResourcePannel()
                 if (ImGui::TreeNodeEx(AppendNextUIID(resource.textures[i].name).c_str()))
                 {
                     ImGui::InputText(GetNextUIID().c_str(), &resource.textures[i].name);
+                    CachedResource* cached = GetCached(&resource.cache, CACHED_TEXTURE, i);
+                    ImGui::Text("References: %d", cached ? cached->references : 1);
                     float width = ImGui::GetContentRegionAvail().x;
                     float aspect = resource.textures[i].width / resource.textures[i].height;
                     ImGui::Image((void*)(resource.textures[i].id), ImVec2(width, width / aspect));
                     if (ImGui::Button(("Remove" + GetNextUIID()).c_str()))
                     {
-                        RemoveTexture(&resource, i);
-                        i--;
+                        if (RemoveTexture(&resource, i)) i--;
                     }
                     ImGui::TreePop();
                 }
@@ -524,11 +584,7 @@ void ProgramManager::RenderResourcePannel()
             }
             if (ImGui::Button("Add") && textureName.size() != 0)
             {
-                Texture texture = {};
-                if (LoadTexture(&texture, textureName, texturePathName))
-                {
-                    resource.textures.push_back(texture);
-                }
+                AcquireTexture(&resource, textureName, texturePathName);
                 loadingTexture = false;
                 textureName = "";
                 texturePathName = "";
@@ -762,7 +818,7 @@ void ProgramManager::RenderModelDetailPannel()
         glm::mat4 modelMatrix = GetModelMatrix(scene.models.positions[selectedModel], scene.models.rotations[selectedModel], scene.models.scales[selectedModel]);
         if (scene.models.animations[selectedModel])
         {
-            std::pair<glm::vec3, glm::vec3> volume = GetAnimationBoundingVolume(scene.models.meshes[selectedModel], scene.models.animations[selectedModel], modelMatrix, frames);
+            std::pair<glm::vec3, glm::vec3> volume = GetAnimationBoundingVolume(scene.models.meshes[selectedModel], scene.models.animations[selectedModel], modelMatrix, frames, preSkinning ? &resource.skinningProgram : nullptr, &resource.bonePalette);
             SnapCameraToBoundingVolume(volume);
         }
         else {
@@ -4,6 +4,8 @@
 #include <iostream>
 #include <filesystem>
 #include <vector>
+#include <algorithm>
+#include <memory>
 #include <unordered_map>
 #include <filesystem>
 #include "Graphics.h"
@@ -20,9 +22,18 @@
 #include "stb_image_write.h"
 
 #include "Utils.h"
+#include "JobSystem.h"
 #include "InputManager.h"
 
 #include "Renderer.h"
+#include "AnimationBatch.h"
+#include "AnimationCompression.h"
+#include "MeshOptimizer.h"
+#include "MappedFile.h"
+#include "AssetCache.h"
+#include "AssetLoader.h"
+#include "ImportBenchmark.h"
+#include "ResourceCache.h"
 #include "ResourceManager.h"
 #include "SceneManager.h"
 #include "GUI.h"
@@ -55,6 +66,7 @@ private:
 	// GLFWwindow* window;
 	Resource resource;
 	Scene scene;
+	JobSystem jobSystem;
 	Input input;
 	Input lastInput;
 	float dt;
@@ -82,6 +94,8 @@ private:
 	bool firstTime = true;
 
 	bool animated = true;
+	// skin animated models once per frame in a compute pass
+	bool preSkinning = false;
 
 	int selectedAnimation = 0;
 };
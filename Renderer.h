@@ -1,11 +1,30 @@
-#define MAX_BONE_INFLUENCE 4
+#define MAX_BONE_INFLUENCE 8
 
+// Triangles of skinned meshes are grouped by the largest influence count of
+// their vertices, each group is drawn with a shader blending only that many bones.
+#define INFLUENCE_BUCKET_COUNT 4
+static const int influenceBucketSizes[INFLUENCE_BUCKET_COUNT] = { 1, 2, 4, 8 };
+
+// Where a uniform lives in a program and in each of its influence variants,
+// -1 where the compiler removed it
+struct UniformLocations
+{
+	GLint program;
+	GLint variants[INFLUENCE_BUCKET_COUNT];
+};
 
 struct ShaderProgram
 {
 	GLuint vertexShader;
 	GLuint fragmentShader;
+	GLuint computeShader;
 	GLuint shaderProgram;
+	// VERTEX_* attributes the vertex shader reads
+	int vertexFormat;
+	// same program compiled per influence bucket, 0 where shaderProgram is used
+	GLuint influenceVariants[INFLUENCE_BUCKET_COUNT];
+	// looked up on the first SetUniform of every name
+	std::unordered_map<std::string, UniformLocations> uniformLocations;
 };
 
 struct Texture
@@ -16,18 +35,31 @@ struct Texture
 	int height;
 };
 
+// Pixels decoded by stbi_load, safe to produce on any thread
+struct TextureData
+{
+	unsigned char* pixels;
+	int width;
+	int height;
+	int channels;
+};
+
+// Imported vertex attributes, InitMesh compresses them into the GPU streams
+struct MeshVertex
+{
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec3 vertTangent;
+	glm::vec3 vertBitangent;
+	glm::vec3 color;
+	glm::vec2 uv;
+};
+
 struct VertexData
 {
 	union
 	{
-		struct {
-			glm::vec3 position;
-			glm::vec3 normal;
-			glm::vec3 vertTangent;
-			glm::vec3 vertBitangent;
-			glm::vec3 color;
-			glm::vec2 uv;
-		} mesh;
+		MeshVertex mesh;
 
 		struct
 		{
@@ -43,28 +75,157 @@ struct VertexData
 };
 
 
+// Vertex formats, the attributes beyond the position a shader reads. Each
+// format gets its own vertex array that only binds those streams.
+#define VERTEX_NORMAL 1
+#define VERTEX_TANGENT 2
+#define VERTEX_COLOR 4
+#define VERTEX_UV 8
+#define VERTEX_SKIN 16
+#define VERTEX_ALL 31
+
+// Mesh streams, positions as floats and the rest compressed:
+// attribute stream: octahedral normal as 2 x snorm16, octahedral tangent and
+// bitangent sign as 4 x snorm8, uv as 2 x half
+// color stream: 4 x unorm8, left out when every vertex is white
+#define POSITION_STREAM 0
+#define ATTRIBUTE_STREAM 1
+#define COLOR_STREAM 2
+#define SKIN_STREAM 3
+#define ATTRIBUTE_STRIDE 12
+
+// Packed skin stream, per vertex all bone ids followed by all weights.
+// Ids take 8 bits when the skeleton allows it, weights are unorm8 or unorm16.
+#define SKIN_WEIGHT_BITS 8
+
+// One aiMesh of an imported scene inside the merged buffers. Indices are
+// local to the submesh, baseVertex is added when drawing.
+struct Submesh
+{
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	int baseVertex;
+	int vertexCount;
+	// indices per influence bucket, stored in bucket order from firstIndex.
+	// All zero when the triangles were never bucketed.
+	unsigned int influenceCounts[INFLUENCE_BUCKET_COUNT];
+	// material slot, the aiMesh's material index
+	int material;
+};
+
+// Arguments of one glMultiDrawElementsBaseVertex call. Draws are sorted by
+// material slot, so the draws of a slot are one contiguous run.
+struct MultiDraw
+{
+	std::vector<GLsizei> counts;
+	std::vector<const void*> offsets;
+	std::vector<GLint> baseVertices;
+	std::vector<int> materials;
+};
+
+// Free part of an arena buffer, kept sorted by offset
+struct FreeRange
+{
+	int offset;
+	int size;
+};
+
+// Streams shared by many meshes. Each mesh owns the same range of vertices
+// in every stream and a range of index bytes, its draws are offsets into the
+// shared buffers and all meshes of an arena share one vertex array per vertex
+// format. The buffers start empty and grow with the meshes placed in them.
+struct MeshArena
+{
+	GLuint vertexBuffer;
+	GLuint attributeBuffer;
+	// always present, white for meshes without colors
+	GLuint colorBuffer;
+	// 0 for the arena of meshes without bone weights
+	GLuint skinBuffer;
+	int skinIndexBits;
+	int skinWeightBits;
+	// 16 and 32 bit indices share the buffer, ranges are in bytes
+	GLuint indexBuffer;
+	std::vector<FreeRange> freeVertices;
+	std::vector<FreeRange> freeIndices;
+	int vertexCapacity;
+	int indexCapacity;
+	std::unordered_map<int, GLuint> formatVaos;
+};
+
 struct Mesh
 {
 	std::string name;
+	// position stream
 	GLuint vertexBuffer;
+	GLuint attributeBuffer;
+	// 0 when every vertex is white
+	GLuint colorBuffer;
 	GLuint indexBuffer;
+	// binds every stream
 	GLuint vao;
-	std::vector<VertexData> vertices;
+	// per vertex format, created on first use
+	std::unordered_map<int, GLuint> formatVaos;
+	int vertexCount;
+	// bind pose and packed skin kept for the cpu bounding volumes
+	std::vector<glm::vec3> positions;
+	std::vector<unsigned char> skin;
 	unsigned int indexCount;
+	// GL_UNSIGNED_SHORT unless a submesh has more than 65536 vertices
+	GLenum indexType;
+	std::vector<Submesh> submeshes;
+	int materialCount;
+	// every submesh, and every submesh split by influence bucket
+	MultiDraw draws;
+	MultiDraw influenceDraws[INFLUENCE_BUCKET_COUNT];
 	bool initialised;
+	// packed skin stream, 0 for meshes without bone weights
+	GLuint skinBuffer;
+	int skinIndexBits;
+	int skinWeightBits;
+	// bounding sphere of the bind pose in model space
+	glm::vec3 boundsCenter;
+	float boundsRadius;
+	// owner of the buffers above, nullptr when the mesh owns them
+	MeshArena* arena;
+	// first vertex and first index byte in the arena, already part of the draws
+	int baseVertex;
+	int indexOffset;
 };
 
-struct Bone
+// Output of the compute skinning pass for one model, drawn like a static mesh
+// with the index buffer of its source mesh.
+struct SkinnedMesh
 {
-	int id;
-	std::string name;
-	glm::mat4 offset;
-	std::vector<Bone> children;
+	Mesh* source;
+	// skinned position and attribute streams
+	GLuint vertexBuffer;
+	GLuint attributeBuffer;
+	GLuint vao;
+	// the arena of the source when the output lives there, nullptr when it
+	// owns its buffers
+	MeshArena* arena;
+	int baseVertex;
+	int vertexCount;
+	// draws of the source moved to the output vertices
+	MultiDraw draws;
 };
 
+// Bones stored in topological order, a bone's parent always comes before it.
+// The index of a bone is also its bone id in the skinning palette.
 struct Skeleton
 {
-	Bone root;
+	std::vector<std::string> names;
+	std::vector<int> parents;
+	std::vector<glm::mat4> offsets;
+	// local node transform, used for bones without an animation channel
+	std::vector<glm::mat4> bindTransforms;
+	// bindTransforms decomposed, channels matching these are static
+	std::vector<glm::vec3> bindPositions;
+	std::vector<glm::quat> bindRotations;
+	std::vector<glm::vec3> bindScales;
+	// chains moving little of the skin, held at their bind transform at reduced detail
+	std::vector<bool> detailBones;
 	int count;
 };
 
@@ -72,9 +233,47 @@ struct Skeleton
 struct MeshData
 {
 	std::vector<VertexData> vertices;
-	std::vector<unsigned short> indices;
+	std::vector<unsigned int> indices;
+	// empty means a single submesh covering everything
+	std::vector<Submesh> submeshes;
+};
+
+// A mesh in the layout of its GL streams, uploaded as-is. The asset cache
+// stores meshes like this.
+struct PackedMesh
+{
+	std::vector<glm::vec3> positions;
+	// ATTRIBUTE_STRIDE bytes per vertex
+	std::vector<unsigned int> attributes;
+	// empty when every vertex is white
+	std::vector<unsigned int> colors;
+	// empty for meshes without bone weights
+	std::vector<unsigned char> skin;
+	int skinIndexBits;
+	int skinWeightBits;
+	// indexCount indices of indexType, local to their submesh
+	std::vector<unsigned char> indices;
+	unsigned int indexCount;
+	GLenum indexType;
+	std::vector<Submesh> submeshes;
+	glm::vec3 boundsCenter;
+	float boundsRadius;
+};
+
+
+// Rotation quantized to 48 bits, smallest three form. The top two bits hold
+// the index of the largest component, the other three take 15 bits each and
+// the largest is rebuilt from the unit length.
+struct PackedQuat
+{
+	unsigned short data[3];
 };
 
+// How a channel varies over a clip. Constant and static channels keep a single
+// key, static ones also match the bind pose of the bone.
+#define CHANNEL_ANIMATED 0
+#define CHANNEL_CONSTANT 1
+#define CHANNEL_STATIC 2
 
 struct BoneTransformTrack
 {
@@ -85,6 +284,20 @@ struct BoneTransformTrack
 	std::vector<glm::vec3> positions;
 	std::vector<glm::quat> rotations;
 	std::vector<glm::vec3> scales;
+	// replaces rotations once the clip is quantized
+	std::vector<PackedQuat> packedRotations;
+
+	int positionKind = CHANNEL_ANIMATED;
+	int rotationKind = CHANNEL_ANIMATED;
+	int scaleKind = CHANNEL_ANIMATED;
+};
+
+// Last key segment sampled for each channel of a bone
+struct TrackCursor
+{
+	int position;
+	int rotation;
+	int scale;
 };
 
 struct Animation
@@ -92,11 +305,45 @@ struct Animation
 	std::string name;
 	float duration;
 	int ticksPersecond;
+	// raw channels keyed by node name, only used until the clip is compiled
 	std::unordered_map<std::string, BoneTransformTrack> boneTransforms;
+	// compiled channels indexed by bone id, tracks without keys have no channel
+	std::vector<BoneTransformTrack> tracks;
 	glm::mat4 globalInverseTransform;
-	std::vector<glm::mat4> currentPose;
-	Bone skeleton;
+	std::shared_ptr<Skeleton> skeleton;
 	int boneCount;
+	// palette baked by BakeAnimation, rows are frames and every bone takes
+	// three texels holding the rows of its 3x4 transform
+	Texture bakedPalette;
+};
+
+// Key times and duration are in ticks, clips without a tick rate count seconds
+static float GetTicksPerSecond(Animation* animation)
+{
+	return animation->ticksPersecond > 0 ? (float)animation->ticksPersecond : 1.0f;
+}
+
+// Elapsed seconds to clip ticks, every sampling site goes through this
+static float GetClipTime(Animation* animation, float seconds)
+{
+	return seconds * GetTicksPerSecond(animation);
+}
+
+// Playback state of one clip on one model. Clips are shared and never written
+// while playing, every instance owns its pose buffer and keyframe cursors.
+struct AnimationInstance
+{
+	Animation* animation;
+	float time;
+	std::vector<glm::mat4> pose;
+	std::vector<TrackCursor> cursors;
+};
+
+struct AnimationInstancePool
+{
+	std::vector<AnimationInstance> instances;
+	std::vector<int> freeList;
+	int count;
 };
 
 struct Camera
@@ -148,6 +395,33 @@ struct SpriteVertex
 	glm::vec2 tiling;
 };
 
+#define BONE_PALETTE_REGIONS 3
+#define BONE_PALETTE_BINDING 0
+
+// how each bone is stored in the palette, the skinning shaders mirror these
+#define PALETTE_MAT4 0
+// the three rows of the affine part
+#define PALETTE_AFFINE 1
+// real and dual part, rigid transforms only
+#define PALETTE_DUAL_QUATERNION 2
+
+// Every instance's skinning palette for a frame, written straight into a
+// persistently mapped shader storage buffer. The buffer is split into regions
+// used round robin, each fenced so the CPU never overwrites one the GPU is
+// still reading.
+struct BonePaletteBuffer
+{
+	GLuint buffer;
+	glm::vec4* mapped;
+	int format;
+	// vec4 entries per region
+	int capacity;
+	int region;
+	int used;
+	bool inFrame;
+	GLsync fences[BONE_PALETTE_REGIONS];
+};
+
 struct SpriteRenderer
 {
 	ShaderProgram* program;
@@ -239,7 +513,16 @@ struct Material
 
 
 // Shader program
-static void InitShaderProgram(ShaderProgram* program, std::string vertexFileName, std::string fragmentFileName)
+
+// GLSL wants #version on the first line, defines go right after it
+static std::string InsertShaderDefines(std::string source, std::string defines)
+{
+	size_t lineEnd = source.find('\n');
+	if (defines.empty() || lineEnd == std::string::npos) return source;
+	return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+}
+
+static void InitShaderProgram(ShaderProgram* program, std::string vertexFileName, std::string fragmentFileName, std::string vertexDefines = "")
 {
     // Init
     program->vertexShader = glCreateShader(GL_VERTEX_SHADER);
@@ -248,7 +531,7 @@ static void InitShaderProgram(ShaderProgram* program, std::string vertexFileName
     bool loaded = true;
 
     // Vertex Shader
-    std::string vertexSource = LoadFileAsString(vertexFileName);
+    std::string vertexSource = InsertShaderDefines(LoadFileAsString(vertexFileName), vertexDefines);
     const char* vertexSourceC = vertexSource.c_str();
     glShaderSource(program->vertexShader, 1, &vertexSourceC, nullptr);
     glCompileShader(program->vertexShader);
@@ -306,64 +589,183 @@ static void InitShaderProgram(ShaderProgram* program, std::string vertexFileName
     {
         std::cout << "Shader program linked successfully" << std::endl;
     }
+
+    // inputs the compiler removed are not fetched either
+    program->vertexFormat = 0;
+    const char* attributeNames[] = { "a_normal", "a_tangent", "a_color", "a_uvs", "a_boneIds" };
+    for (int i = 0; i < 5; i++)
+    {
+        if (glGetAttribLocation(program->shaderProgram, attributeNames[i]) != -1)
+        {
+            program->vertexFormat |= 1 << i;
+        }
+    }
+}
+
+// Compile the skinning vertex shader once per influence bucket. The last
+// bucket blends MAX_BONE_INFLUENCE bones and uses the program itself.
+static void InitInfluenceVariants(ShaderProgram* program, std::string vertexFileName, std::string fragmentFileName)
+{
+    for (int i = 0; i < INFLUENCE_BUCKET_COUNT; i++)
+    {
+        if (influenceBucketSizes[i] == MAX_BONE_INFLUENCE) continue;
+        ShaderProgram variant = {};
+        InitShaderProgram(&variant, vertexFileName, fragmentFileName, "#define MAX_BONE_INFLUENCE " + std::to_string(influenceBucketSizes[i]) + "\n");
+        program->influenceVariants[i] = variant.shaderProgram;
+    }
+    program->uniformLocations.clear();
+}
+
+static GLuint GetInfluenceVariant(ShaderProgram* program, int bucket)
+{
+    return program->influenceVariants[bucket] ? program->influenceVariants[bucket] : program->shaderProgram;
+}
+
+static void InitComputeProgram(ShaderProgram* program, std::string computeFileName)
+{
+    *program = {};
+    program->computeShader = glCreateShader(GL_COMPUTE_SHADER);
+    program->shaderProgram = glCreateProgram();
+
+    std::string computeSource = LoadFileAsString(computeFileName);
+    const char* computeSourceC = computeSource.c_str();
+    glShaderSource(program->computeShader, 1, &computeSourceC, nullptr);
+    glCompileShader(program->computeShader);
+
+    GLchar errorLog[512];
+    GLint success = 0;
+    glGetShaderiv(program->computeShader, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        std::cout << "Compute shader " << computeFileName << " failed with error:" << std::endl;
+        glGetShaderInfoLog(program->computeShader, 512, nullptr, errorLog);
+        std::cout << errorLog << std::endl;
+        return;
+    }
+    std::cout << computeFileName << " compiled successfully." << std::endl;
+
+    glAttachShader(program->shaderProgram, program->computeShader);
+    glLinkProgram(program->shaderProgram);
+    glGetProgramiv(program->shaderProgram, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        std::cout << "Error linking compute shader " << computeFileName << std::endl;
+        glGetProgramInfoLog(program->shaderProgram, 512, nullptr, errorLog);
+        std::cout << errorLog << std::endl;
+        return;
+    }
+    std::cout << "Compute program linked successfully" << std::endl;
+}
+
+static UniformLocations& GetUniformLocations(ShaderProgram* program, const std::string& varname)
+{
+	auto cached = program->uniformLocations.find(varname);
+	if (cached != program->uniformLocations.end()) return cached->second;
+
+	UniformLocations& locations = program->uniformLocations[varname];
+	locations.program = glGetUniformLocation(program->shaderProgram, varname.c_str());
+	for (int i = 0; i < INFLUENCE_BUCKET_COUNT; i++)
+	{
+		GLuint variant = program->influenceVariants[i];
+		locations.variants[i] = variant ? glGetUniformLocation(variant, varname.c_str()) : -1;
+	}
+	return locations;
 }
 
 static void SetUniform(ShaderProgram* program, std::string varname, float value)
 {
-	GLuint varloc = glGetUniformLocation(program->shaderProgram, varname.c_str());
+	UniformLocations& locations = GetUniformLocations(program, varname);
 	glUseProgram(program->shaderProgram);
-	glUniform1f(varloc, value);
+	glUniform1f(locations.program, value);
+	for (int i = 0; i < INFLUENCE_BUCKET_COUNT; i++)
+	{
+		if (locations.variants[i] != -1) glProgramUniform1f(program->influenceVariants[i], locations.variants[i], value);
+	}
 }
 
 static void SetUniform(ShaderProgram* program, std::string varname, float& value, int count)
 {
-	GLuint varloc = glGetUniformLocation(program->shaderProgram, varname.c_str());
+	UniformLocations& locations = GetUniformLocations(program, varname);
 	glUseProgram(program->shaderProgram);
-	glUniform1fv(varloc, count, &value);
+	glUniform1fv(locations.program, count, &value);
+	for (int i = 0; i < INFLUENCE_BUCKET_COUNT; i++)
+	{
+		if (locations.variants[i] != -1) glProgramUniform1fv(program->influenceVariants[i], locations.variants[i], count, &value);
+	}
 }
 
 static void SetUniform(ShaderProgram* program, std::string varname, glm::mat4 value)
 {
-	GLuint varloc = glGetUniformLocation(program->shaderProgram, varname.c_str());
+	UniformLocations& locations = GetUniformLocations(program, varname);
 	glUseProgram(program->shaderProgram);
-	glUniformMatrix4fv(varloc, 1, GL_FALSE, &value[0][0]);
+	glUniformMatrix4fv(locations.program, 1, GL_FALSE, &value[0][0]);
+	for (int i = 0; i < INFLUENCE_BUCKET_COUNT; i++)
+	{
+		if (locations.variants[i] != -1) glProgramUniformMatrix4fv(program->influenceVariants[i], locations.variants[i], 1, GL_FALSE, &value[0][0]);
+	}
 }
 
 static void SetUniform(ShaderProgram* program, std::string varname, glm::mat4& value, int count)
 {
-	GLuint varloc = glGetUniformLocation(program->shaderProgram, varname.c_str());
+	UniformLocations& locations = GetUniformLocations(program, varname);
 	glUseProgram(program->shaderProgram);
-	glUniformMatrix4fv(varloc, count, GL_FALSE, &value[0][0]);
+	glUniformMatrix4fv(locations.program, count, GL_FALSE, &value[0][0]);
+	for (int i = 0; i < INFLUENCE_BUCKET_COUNT; i++)
+	{
+		if (locations.variants[i] != -1) glProgramUniformMatrix4fv(program->influenceVariants[i], locations.variants[i], count, GL_FALSE, &value[0][0]);
+	}
 }
 
 static void SetUniform(ShaderProgram* program, std::string varname, glm::vec3 value)
 {
-	GLuint varloc = glGetUniformLocation(program->shaderProgram, varname.c_str());
+	UniformLocations& locations = GetUniformLocations(program, varname);
 	glUseProgram(program->shaderProgram);
-	glUniform3fv(varloc, 1, &value[0]);
+	glUniform3fv(locations.program, 1, &value[0]);
+	for (int i = 0; i < INFLUENCE_BUCKET_COUNT; i++)
+	{
+		if (locations.variants[i] != -1) glProgramUniform3fv(program->influenceVariants[i], locations.variants[i], 1, &value[0]);
+	}
 }
 
 static void SetUniform(ShaderProgram* program, std::string varname, glm::vec3& value, int count)
 {
-	GLuint varloc = glGetUniformLocation(program->shaderProgram, varname.c_str());
+	UniformLocations& locations = GetUniformLocations(program, varname);
 	glUseProgram(program->shaderProgram);
-	glUniform3fv(varloc, count, &value[0]);
+	glUniform3fv(locations.program, count, &value[0]);
+	for (int i = 0; i < INFLUENCE_BUCKET_COUNT; i++)
+	{
+		if (locations.variants[i] != -1) glProgramUniform3fv(program->influenceVariants[i], locations.variants[i], count, &value[0]);
+	}
 }
 
 static void SetUniform(ShaderProgram* program, std::string varname, int value)
 {
-	GLuint varloc = glGetUniformLocation(program->shaderProgram, varname.c_str());
+	UniformLocations& locations = GetUniformLocations(program, varname);
 	glUseProgram(program->shaderProgram);
-	glUniform1i(varloc, value);
+	glUniform1i(locations.program, value);
+	for (int i = 0; i < INFLUENCE_BUCKET_COUNT; i++)
+	{
+		if (locations.variants[i] != -1) glProgramUniform1i(program->influenceVariants[i], locations.variants[i], value);
+	}
 }
 
 
 // Texture
-static bool LoadTexture(Texture* texture, std::string name, std::string filename)
+static bool DecodeTexture(TextureData* textureData, std::string filename)
+{
+	*textureData = {};
+	textureData->pixels = stbi_load(filename.c_str(), &textureData->width, &textureData->height, &textureData->channels, 0);
+	return textureData->pixels != nullptr;
+}
+
+// GL side of LoadTexture, frees the decoded pixels
+static bool UploadTexture(Texture* texture, std::string name, TextureData* textureData)
 {
 	bool loaded = false;
-	int width, height, channels;
-	unsigned char* data = stbi_load(filename.c_str(), &width, &height, &channels, 0);
+	int width = textureData->width;
+	int height = textureData->height;
+	int channels = textureData->channels;
+	unsigned char* data = textureData->pixels;
 	glGenTextures(1, &texture->id);
 	glBindTexture(GL_TEXTURE_2D, texture->id);
 	texture->width = width;
@@ -399,6 +801,7 @@ static bool LoadTexture(Texture* texture, std::string name, std::string filename
 
 	glBindTexture(GL_TEXTURE_2D, 0);
 	stbi_image_free(data);
+	textureData->pixels = nullptr;
 	if (!loaded)
 	{
 		glDeleteTextures(1, &texture->id);
@@ -407,6 +810,13 @@ static bool LoadTexture(Texture* texture, std::string name, std::string filename
 	return true;
 }
 
+static bool LoadTexture(Texture* texture, std::string name, std::string filename)
+{
+	TextureData textureData;
+	DecodeTexture(&textureData, filename);
+	return UploadTexture(texture, name, &textureData);
+}
+
 static void InitTexture(Texture* texture, char* data, int width, int height)
 {
 	texture->width = width;
@@ -477,33 +887,65 @@ static glm::quat ConvertAssimpToGLM(aiQuaternion quat)
 
 // Mesh
 
-static bool ReadBone(Bone& bone, aiNode* node, std::unordered_map<std::string, std::pair<int, glm::mat4>>& boneInfoTable)
+static void ReadSkeleton(Skeleton* skeleton, aiNode* node, int parent, std::unordered_map<std::string, glm::mat4>& boneOffsets)
 {
-	if (boneInfoTable.find(node->mName.C_Str()) != boneInfoTable.end())
+	auto bone = boneOffsets.find(node->mName.C_Str());
+	if (bone != boneOffsets.end())
 	{
-		bone.name = node->mName.C_Str();
-		bone.id = boneInfoTable[bone.name].first;
-		bone.offset = boneInfoTable[bone.name].second;
+		skeleton->names.push_back(bone->first);
+		skeleton->parents.push_back(parent);
+		skeleton->offsets.push_back(bone->second);
+		skeleton->bindTransforms.push_back(ConvertAssimpToGLM(node->mTransformation));
+		aiVector3D scaling;
+		aiQuaternion rotation;
+		aiVector3D position;
+		node->mTransformation.Decompose(scaling, rotation, position);
+		skeleton->bindPositions.push_back(ConvertAssimpToGLM(position));
+		skeleton->bindRotations.push_back(ConvertAssimpToGLM(rotation));
+		skeleton->bindScales.push_back(ConvertAssimpToGLM(scaling));
+		parent = skeleton->count;
+		skeleton->count++;
+	}
 
-		for (int i = 0; i < node->mNumChildren; i++)
-		{
-			Bone child;
-			ReadBone(child, node->mChildren[i], boneInfoTable);
-			bone.children.push_back(child);
-		}
-		return true;
+	for (int i = 0; i < node->mNumChildren; i++)
+	{
+		ReadSkeleton(skeleton, node->mChildren[i], parent, boneOffsets);
 	}
-	else
+}
+
+// share of the total skin weight below which a bone and its children are detail
+#define DETAIL_BONE_WEIGHT 0.01f
+
+// A bone is a detail bone when it and all of its children together move less
+// than detailWeight of the skin. Children only ever weigh less than their
+// parent's subtree, so whole chains such as fingers drop out together.
+static void MarkDetailBones(Skeleton* skeleton, MeshData* meshData, float detailWeight = DETAIL_BONE_WEIGHT)
+{
+	std::vector<float> subtreeWeights(skeleton->count, 0.0f);
+	for (int i = 0; i < meshData->vertices.size(); i++)
 	{
-		for (int i = 0; i < node->mNumChildren; i++)
+		VertexData& vertex = meshData->vertices[i];
+		for (int k = 0; k < MAX_BONE_INFLUENCE && vertex.animated.weights[k] > 0.0f; k++)
 		{
-			if (ReadBone(bone, node->mChildren[i], boneInfoTable))
-			{
-				return true;
-			}
+			subtreeWeights[vertex.animated.boneIDs[k]] += vertex.animated.weights[k];
 		}
 	}
-	return false;
+
+	// children come after their parents, so walking backwards sums every subtree
+	float totalWeight = 0.0f;
+	for (int i = skeleton->count - 1; i >= 0; i--)
+	{
+		int parent = skeleton->parents[i];
+		if (parent >= 0) subtreeWeights[parent] += subtreeWeights[i];
+		else totalWeight += subtreeWeights[i];
+	}
+
+	skeleton->detailBones.assign(skeleton->count, false);
+	if (totalWeight <= 0.0f) return;
+	for (int i = 0; i < skeleton->count; i++)
+	{
+		skeleton->detailBones[i] = subtreeWeights[i] < detailWeight * totalWeight;
+	}
 }
 
 static MeshData LoadMeshData(const aiScene* scene, int index)
@@ -569,225 +1011,1564 @@ static MeshData LoadMeshData(const aiScene* scene, int index)
 	}
 
 	
+	meshData.submeshes.push_back({ 0, (unsigned int)meshData.indices.size(), 0, (int)meshData.vertices.size() });
+	meshData.submeshes.back().material = meshInfo->mMaterialIndex;
 	return meshData;
 
 }
 
-static void LoadBoneData(const aiScene* scene, MeshData* meshData, Bone& skeleton, int& boneCount)
+// Global transform of the first node showing each aiMesh
+static void GetMeshTransforms(const aiNode* node, glm::mat4 parentTransform, std::vector<glm::mat4>& transforms, std::vector<bool>& placed)
 {
-	//MeshData meshData = LoadMeshData(scene);
-	aiMesh* meshInfo = scene->mMeshes[0];
+	glm::mat4 transform = parentTransform * ConvertAssimpToGLM(node->mTransformation);
+	for (int i = 0; i < node->mNumMeshes; i++)
+	{
+		int mesh = node->mMeshes[i];
+		if (placed[mesh]) continue;
+		transforms[mesh] = transform;
+		placed[mesh] = true;
+	}
+	for (int i = 0; i < node->mNumChildren; i++)
+	{
+		GetMeshTransforms(node->mChildren[i], transform, transforms, placed);
+	}
+}
 
-	std::unordered_map<std::string, std::pair<int, glm::mat4>> boneInfo = {};
-	std::vector<int> boneCounts;
-	boneCounts.resize(meshData->vertices.size(), 0);
-	for (int i = 0; i < meshInfo->mNumBones; i++)
+// Where each aiMesh sits in the scene. Skinned meshes stay in mesh space, the
+// bone offsets expect it, and so do meshes no node shows.
+static std::vector<glm::mat4> GetMeshTransforms(const aiScene* scene)
+{
+	std::vector<glm::mat4> transforms(scene->mNumMeshes, glm::mat4(1.0f));
+	std::vector<bool> placed(scene->mNumMeshes, false);
+	if (scene->mRootNode) GetMeshTransforms(scene->mRootNode, glm::mat4(1.0f), transforms, placed);
+	for (int i = 0; i < scene->mNumMeshes; i++)
 	{
-		aiBone* bone = meshInfo->mBones[i];
-		glm::mat4 m = ConvertAssimpToGLM(bone->mOffsetMatrix);
-		boneInfo[bone->mName.C_Str()] = { i, m };
+		if (scene->mMeshes[i]->HasBones()) transforms[i] = glm::mat4(1.0f);
+	}
+	return transforms;
+}
 
-		for (int j = 0; j < bone->mNumWeights; j++)
-		{
-			int id = bone->mWeights[j].mVertexId;
-			float weight = bone->mWeights[j].mWeight;
+// zero vectors stand for missing normals and tangents and stay zero
+static glm::vec3 TransformDirection(const glm::mat3& matrix, glm::vec3 direction)
+{
+	glm::vec3 result = matrix * direction;
+	float length = glm::length(result);
+	return length > 0.0f ? result / length : result;
+}
 
-			switch (boneCounts[id])
-			{
-			case 0:
-				meshData->vertices[id].animated.boneIDs[0] = i;
-				meshData->vertices[id].animated.weights[0] = weight;
-				break;
-			case 1:
-				meshData->vertices[id].animated.boneIDs[1] = i;
-				meshData->vertices[id].animated.weights[1] = weight;
-				break;
-			case 2:
-				meshData->vertices[id].animated.boneIDs[2] = i;
-				meshData->vertices[id].animated.weights[2] = weight;
-				break;
-			case 3:
-				meshData->vertices[id].animated.boneIDs[3] = i;
-				meshData->vertices[id].animated.weights[3] = weight;
-				break;
-			default:
-				break;
-			}
-			boneCounts[id]++;
-		}
+// Move vertices [begin, end) from mesh space into scene space
+static void TransformVertices(VertexData* vertices, int begin, int end, const glm::mat4& transform)
+{
+	glm::mat3 linear = glm::mat3(transform);
+	glm::mat3 normalMatrix = glm::transpose(glm::inverse(linear));
+	for (int i = begin; i < end; i++)
+	{
+		MeshVertex& vertex = vertices[i].mesh;
+		vertex.position = glm::vec3(transform * glm::vec4(vertex.position, 1.0f));
+		vertex.normal = TransformDirection(normalMatrix, vertex.normal);
+		vertex.vertTangent = TransformDirection(linear, vertex.vertTangent);
+		vertex.vertBitangent = TransformDirection(linear, vertex.vertBitangent);
 	}
-
-	boneCount = meshInfo->mNumBones;
-	ReadBone(skeleton, scene->mRootNode, boneInfo);
 }
 
-static std::vector<Animation> LoadAnimations(const aiScene* scene, MeshData* meshData)
+// vertices and triangles per conversion job
+#define CONVERT_GRAIN_SIZE 16384
+
+// Convert vertices [begin, end) of meshInfo one attribute stream at a time,
+// the Has* checks are made once per stream instead of once per vertex.
+// vertices are zeroed already.
+static void ConvertVertexStreams(const aiMesh* meshInfo, VertexData* vertices, int begin, int end)
 {
-	std::vector<Animation> animations;
-	aiAnimation** animationInfos = scene->mAnimations;
-	aiNode* root = scene->mRootNode;
+	const aiVector3D* positions = meshInfo->mVertices;
+	for (int i = begin; i < end; i++)
+	{
+		vertices[i].mesh.position = glm::vec3(positions[i].x, positions[i].y, positions[i].z);
+	}
 
-	Bone skeleton = {};
-	int boneCount = 0;
+	if (meshInfo->HasVertexColors(0))
+	{
+		const aiColor4D* colors = meshInfo->mColors[0];
+		for (int i = begin; i < end; i++)
+		{
+			vertices[i].mesh.color = glm::vec3(colors[i].r, colors[i].g, colors[i].b);
+		}
+	}
+	else
+	{
+		for (int i = begin; i < end; i++)
+		{
+			vertices[i].mesh.color = glm::vec3(1.0f);
+		}
+	}
 
-	LoadBoneData(scene, meshData, skeleton, boneCount);
+	if (meshInfo->HasTextureCoords(0))
+	{
+		const aiVector3D* uvs = meshInfo->mTextureCoords[0];
+		for (int i = begin; i < end; i++)
+		{
+			vertices[i].mesh.uv = glm::vec2(uvs[i].x, uvs[i].y);
+		}
+	}
+	else
+	{
+		for (int i = begin; i < end; i++)
+		{
+			vertices[i].mesh.uv = glm::vec2(positions[i].x, positions[i].y);
+		}
+	}
 
-	for (int i = 0; i < scene->mNumAnimations; i++)
+	if (meshInfo->HasNormals())
 	{
-		aiAnimation* anim = animationInfos[i];
-		Animation animation = {};
-		animation.duration = anim->mDuration;
-		animation.ticksPersecond = anim->mTicksPerSecond;
-		animation.globalInverseTransform = glm::inverse(ConvertAssimpToGLM(scene->mRootNode->mTransformation));
-		animation.boneCount = boneCount;
-		animation.skeleton = skeleton;
-		animation.name = anim->mName.C_Str();
+		const aiVector3D* normals = meshInfo->mNormals;
+		for (int i = begin; i < end; i++)
+		{
+			vertices[i].mesh.normal = glm::vec3(normals[i].x, normals[i].y, normals[i].z);
+		}
+	}
 
-		for (int j = 0; j < anim->mNumChannels; j++)
+	if (meshInfo->HasTangentsAndBitangents())
+	{
+		const aiVector3D* tangents = meshInfo->mTangents;
+		const aiVector3D* bitangents = meshInfo->mBitangents;
+		for (int i = begin; i < end; i++)
 		{
-			aiNodeAnim* channel = anim->mChannels[j];
-			BoneTransformTrack track;
-			for (int k = 0; k < channel->mNumPositionKeys; k++)
-			{
-				track.positionTimestamps.push_back(channel->mPositionKeys[k].mTime);
-				track.positions.push_back(ConvertAssimpToGLM(channel->mPositionKeys[k].mValue));
-			}
+			vertices[i].mesh.vertTangent = glm::vec3(tangents[i].x, tangents[i].y, tangents[i].z);
+			vertices[i].mesh.vertBitangent = glm::vec3(bitangents[i].x, bitangents[i].y, bitangents[i].z);
+		}
+	}
+}
 
-			for (int k = 0; k < channel->mNumRotationKeys; k++)
-			{
-				track.rotationTimestamps.push_back(channel->mRotationKeys[k].mTime);
-				track.rotations.push_back(ConvertAssimpToGLM(channel->mRotationKeys[k].mValue));
-			}
+// Every aiMesh of the scene merged into one MeshData, one submesh each, moved
+// to where its node places it. The arrays are sized up front and filled in
+// parallel ranges on jobSystem, nullptr converts on the calling thread.
+static MeshData LoadSceneMeshData(const aiScene* scene, JobSystem* jobSystem = nullptr)
+{
+	MeshData meshData = {};
+	unsigned int vertexCount = 0;
+	unsigned int indexCount = 0;
+	for (int i = 0; i < scene->mNumMeshes; i++)
+	{
+		aiMesh* meshInfo = scene->mMeshes[i];
+		meshData.submeshes.push_back({ indexCount, meshInfo->mNumFaces * 3, (int)vertexCount, (int)meshInfo->mNumVertices });
+		meshData.submeshes.back().material = meshInfo->mMaterialIndex;
+		vertexCount += meshInfo->mNumVertices;
+		indexCount += meshInfo->mNumFaces * 3;
+	}
+	meshData.vertices.resize(vertexCount);
+	meshData.indices.resize(indexCount);
+	std::vector<glm::mat4> transforms = GetMeshTransforms(scene);
 
-			for (int k = 0; k < channel->mNumScalingKeys; k++)
+	for (int m = 0; m < scene->mNumMeshes; m++)
+	{
+		const aiMesh* meshInfo = scene->mMeshes[m];
+		VertexData* vertices = meshData.vertices.data() + meshData.submeshes[m].baseVertex;
+		unsigned int* indices = meshData.indices.data() + meshData.submeshes[m].firstIndex;
+		const glm::mat4& transform = transforms[m];
+		bool placed = transform != glm::mat4(1.0f);
+		ParallelFor(jobSystem, meshInfo->mNumVertices, CONVERT_GRAIN_SIZE, [meshInfo, vertices, &transform, placed](int begin, int end) {
+			ConvertVertexStreams(meshInfo, vertices, begin, end);
+			if (placed) TransformVertices(vertices, begin, end, transform);
+		});
+		ParallelFor(jobSystem, meshInfo->mNumFaces, CONVERT_GRAIN_SIZE, [meshInfo, indices](int begin, int end) {
+			for (int i = begin; i < end; i++)
 			{
-				track.scaleTimestamps.push_back(channel->mScalingKeys[k].mTime);
-				track.scales.push_back(ConvertAssimpToGLM(channel->mScalingKeys[k].mValue));
+				const unsigned int* face = meshInfo->mFaces[i].mIndices;
+				indices[i * 3 + 0] = face[0];
+				indices[i * 3 + 1] = face[1];
+				indices[i * 3 + 2] = face[2];
 			}
-			animation.boneTransforms[channel->mNodeName.C_Str()] = track;
-		}
-		animations.push_back(animation);
+		});
 	}
-	return animations;
+	return meshData;
 }
 
-static std::pair<int, float> GetTimeFraction(std::vector<float>& times, float& dt) {
-	int segment = 0;
-	while (dt >= times[segment])
-		segment++;
-	float start = times[segment - 1];
-	float end = times[segment];
-	float frac = (dt - start) / (end - start);
-	return { segment, frac };
+// Meshes built by hand have no submesh table, they are one submesh
+static void InitSubmeshes(MeshData* meshData)
+{
+	if (!meshData->submeshes.empty()) return;
+	meshData->submeshes.push_back({ 0, (unsigned int)meshData->indices.size(), 0, (int)meshData->vertices.size() });
 }
 
-
-static void GetPose(Animation* animation, Bone& skeleton, float dt, glm::mat4& parentTransform)
+// Material slots of the mesh, the largest slot of its submeshes plus one
+static int GetMaterialCount(const std::vector<Submesh>& submeshes)
 {
-	if (animation->boneTransforms.find(skeleton.name) == animation->boneTransforms.end()) return;
-	BoneTransformTrack& btt = animation->boneTransforms[skeleton.name];
-	dt = fmod(dt, animation->duration);
-	std::pair<int, float> fp;
-	fp = GetTimeFraction(btt.positionTimestamps, dt);
-
-	glm::vec3 position1 = btt.positions[fp.first - 1];
-	glm::vec3 position2 = btt.positions[fp.first];
-
-	glm::vec3 position = glm::mix(position1, position2, fp.second);
-
-	fp = GetTimeFraction(btt.rotationTimestamps, dt);
-	glm::quat rotation1 = btt.rotations[fp.first - 1];
-	glm::quat rotation2 = btt.rotations[fp.first];
-
-	glm::quat rotation = glm::slerp(rotation1, rotation2, fp.second);
-
-	fp = GetTimeFraction(btt.scaleTimestamps, dt);
-	glm::vec3 scale1 = btt.scales[fp.first - 1];
-	glm::vec3 scale2 = btt.scales[fp.first];
-
-	glm::vec3 scale = glm::mix(scale1, scale2, fp.second);
+	int count = 1;
+	for (int i = 0; i < submeshes.size(); i++)
+	{
+		count = std::max(count, submeshes[i].material + 1);
+	}
+	return count;
+}
 
-	glm::mat4 positionMat = glm::mat4(1.0f);
-	glm::mat4 scaleMat = glm::mat4(1.0f);
+static int GetInfluenceCount(VertexData& vertex)
+{
+	int count = 0;
+	while (count < MAX_BONE_INFLUENCE && vertex.animated.weights[count] > 0.0f) count++;
+	return count;
+}
 
-	positionMat = glm::translate(positionMat, position);
-	glm::mat4 rotationMat = glm::toMat4(rotation);
-	scaleMat = glm::scale(scaleMat, scale);
-	glm::mat4 localTransform = positionMat * rotationMat * scaleMat;
-	glm::mat4 globalTransform = parentTransform * localTransform;
+// Reorder the triangles so every influence bucket of a submesh is one
+// contiguous index range
+static void BucketTrianglesByInfluence(MeshData* meshData)
+{
+	InitSubmeshes(meshData);
+	for (int s = 0; s < meshData->submeshes.size(); s++)
+	{
+		Submesh& submesh = meshData->submeshes[s];
+		std::vector<unsigned int> buckets[INFLUENCE_BUCKET_COUNT];
+		for (unsigned int i = submesh.firstIndex; i + 2 < submesh.firstIndex + submesh.indexCount; i += 3)
+		{
+			int influenceCount = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				influenceCount = std::max(influenceCount, GetInfluenceCount(meshData->vertices[submesh.baseVertex + meshData->indices[i + k]]));
+			}
 
-	/*output[skeleton.id] = animation.globalInverseTransform * globalTransform * skeleton.offset;
-	outputBone[skeleton.id] = globalTransform;*/
-	animation->currentPose[skeleton.id] = animation->globalInverseTransform * globalTransform * skeleton.offset;
+			int bucket = 0;
+			while (influenceBucketSizes[bucket] < influenceCount) bucket++;
+			buckets[bucket].insert(buckets[bucket].end(), meshData->indices.begin() + i, meshData->indices.begin() + i + 3);
+		}
 
-	for (Bone& child : skeleton.children)
-	{
-		GetPose(animation, child, dt, globalTransform);
+		unsigned int offset = submesh.firstIndex;
+		for (int i = 0; i < INFLUENCE_BUCKET_COUNT; i++)
+		{
+			submesh.influenceCounts[i] = buckets[i].size();
+			std::copy(buckets[i].begin(), buckets[i].end(), meshData->indices.begin() + offset);
+			offset += buckets[i].size();
+		}
 	}
 }
 
-static void InitMesh(std::string name, Mesh* mesh, MeshData* meshData)
+// Bone hierarchy of the scene with the offsets of every mesh's bones
+static void LoadSkeleton(const aiScene* scene, Skeleton* skeleton)
 {
-	unsigned int indexCount = meshData->indices.size();
-	unsigned int vertexCount = meshData->vertices.size();
+	std::unordered_map<std::string, glm::mat4> boneOffsets = {};
+	for (int m = 0; m < scene->mNumMeshes; m++)
+	{
+		aiMesh* meshInfo = scene->mMeshes[m];
+		for (int i = 0; i < meshInfo->mNumBones; i++)
+		{
+			aiBone* bone = meshInfo->mBones[i];
+			boneOffsets[bone->mName.C_Str()] = ConvertAssimpToGLM(bone->mOffsetMatrix);
+		}
+	}
+
+	*skeleton = {};
+	ReadSkeleton(skeleton, scene->mRootNode, -1, boneOffsets);
+	// marked from the skin weights once they are known, see LoadBoneData
+	skeleton->detailBones.assign(skeleton->count, false);
+}
+
+static std::unordered_map<std::string, int> GetBoneIds(Skeleton* skeleton)
+{
+	std::unordered_map<std::string, int> boneIds = {};
+	for (int i = 0; i < skeleton->count; i++)
+	{
+		boneIds[skeleton->names[i]] = i;
+	}
+	return boneIds;
+}
+
+// Heavier first, ties by bone so the result doesn't depend on the sort
+static bool HeavierInfluence(const std::pair<float, int>& a, const std::pair<float, int>& b)
+{
+	return a.first != b.first ? a.first > b.first : a.second < b.second;
+}
+
+// Write the skin weights of every vertex. Assimp stores them per bone, they
+// are bucketed per vertex into one flat array first, then every vertex picks
+// its heaviest influences from its own bucket in parallel.
+static void GatherBoneWeights(const aiScene* scene, MeshData* meshData, const std::unordered_map<std::string, int>& boneIds, JobSystem* jobSystem = nullptr)
+{
+	// submesh i holds scene->mMeshes[i], see LoadSceneMeshData
+	InitSubmeshes(meshData);
+	int meshCount = std::min((int)scene->mNumMeshes, (int)meshData->submeshes.size());
+	int vertexCount = meshData->vertices.size();
+
+	// bone of every aiBone, -1 for bones the skeleton doesn't have
+	std::vector<std::vector<int>> boneIndices(meshCount);
+	std::vector<int> bucketStarts(vertexCount + 1, 0);
+	for (int m = 0; m < meshCount; m++)
+	{
+		aiMesh* meshInfo = scene->mMeshes[m];
+		int baseVertex = meshData->submeshes[m].baseVertex;
+		boneIndices[m].resize(meshInfo->mNumBones, -1);
+		for (int i = 0; i < meshInfo->mNumBones; i++)
+		{
+			aiBone* bone = meshInfo->mBones[i];
+			auto boneId = boneIds.find(bone->mName.C_Str());
+			if (boneId == boneIds.end()) continue;
+			boneIndices[m][i] = boneId->second;
+			for (int j = 0; j < bone->mNumWeights; j++)
+			{
+				bucketStarts[baseVertex + bone->mWeights[j].mVertexId + 1]++;
+			}
+		}
+	}
+	for (int i = 0; i < vertexCount; i++)
+	{
+		bucketStarts[i + 1] += bucketStarts[i];
+	}
+
+	// every influence of a vertex, weight first so they sort by it
+	std::vector<std::pair<float, int>> influences(bucketStarts[vertexCount]);
+	std::vector<int> bucketEnds(bucketStarts.begin(), bucketStarts.end() - 1);
+	for (int m = 0; m < meshCount; m++)
+	{
+		aiMesh* meshInfo = scene->mMeshes[m];
+		int baseVertex = meshData->submeshes[m].baseVertex;
+		for (int i = 0; i < meshInfo->mNumBones; i++)
+		{
+			if (boneIndices[m][i] < 0) continue;
+			aiBone* bone = meshInfo->mBones[i];
+			for (int j = 0; j < bone->mNumWeights; j++)
+			{
+				int id = baseVertex + bone->mWeights[j].mVertexId;
+				influences[bucketEnds[id]++] = { bone->mWeights[j].mWeight, boneIndices[m][i] };
+			}
+		}
+	}
+
+	// keep the heaviest influences and renormalize, so the shader can stop
+	// at the first zero weight
+	std::atomic<int> truncated(0);
 	VertexData* vertices = meshData->vertices.data();
-	unsigned short* indices = meshData->indices.data();
+	ParallelFor(jobSystem, vertexCount, CONVERT_GRAIN_SIZE, [&](int begin, int end) {
+		int rangeTruncated = 0;
+		for (int i = begin; i < end; i++)
+		{
+			std::pair<float, int>* first = influences.data() + bucketStarts[i];
+			int count = bucketStarts[i + 1] - bucketStarts[i];
+			int kept = std::min(count, MAX_BONE_INFLUENCE);
+			std::partial_sort(first, first + kept, first + count, HeavierInfluence);
+			rangeTruncated += count > kept;
+
+			float total = 0.0f;
+			for (int k = 0; k < kept; k++)
+			{
+				total += first[k].first;
+			}
+			for (int k = 0; k < kept; k++)
+			{
+				vertices[i].animated.boneIDs[k] = first[k].second;
+				vertices[i].animated.weights[k] = total > 0.0f ? first[k].first / total : 0.0f;
+			}
+		}
+		truncated += rangeTruncated;
+	});
+	if (truncated)
+	{
+		std::cout << truncated << " vertices had more than " << MAX_BONE_INFLUENCE << " bone influences" << std::endl;
+	}
+}
+
+static void LoadBoneData(const aiScene* scene, MeshData* meshData, Skeleton* skeleton, JobSystem* jobSystem = nullptr)
+{
+	LoadSkeleton(scene, skeleton);
+	GatherBoneWeights(scene, meshData, GetBoneIds(skeleton), jobSystem);
+	MarkDetailBones(skeleton, meshData);
+	BucketTrianglesByInfluence(meshData);
+}
+
+#define STATIC_POSITION_TOLERANCE 1e-4f
+#define STATIC_ROTATION_TOLERANCE 1e-4f
+#define STATIC_SCALE_TOLERANCE 1e-5f
+
+static float KeyError(const glm::vec3& a, const glm::vec3& b)
+{
+	return glm::length(a - b);
+}
+
+// angle between two rotations in radians, from the chord so it stays
+// accurate for the tiny differences acos can't resolve
+static float KeyError(const glm::quat& a, const glm::quat& b)
+{
+	float sign = glm::dot(a, b) < 0.0f ? -1.0f : 1.0f;
+	float chord = 0.0f;
+	for (int k = 0; k < 4; k++)
+	{
+		float d = a[k] - b[k] * sign;
+		chord += d * d;
+	}
+	return 4.0f * std::asin(std::min(std::sqrt(chord) * 0.5f, 1.0f));
+}
+
+// collapses constant and static channels to a single key
+template <typename T>
+static int ClassifyChannel(std::vector<float>& timestamps, std::vector<T>& values, const T& bindValue, float tolerance)
+{
+	bool constant = true;
+	bool matchesBind = true;
+	for (int i = 0; i < values.size() && (constant || matchesBind); i++)
+	{
+		constant = constant && KeyError(values[i], values[0]) <= tolerance;
+		matchesBind = matchesBind && KeyError(values[i], bindValue) <= tolerance;
+	}
+	if (!constant && !matchesBind) return CHANNEL_ANIMATED;
+
+	timestamps.resize(1);
+	values.resize(1);
+	timestamps.shrink_to_fit();
+	values.shrink_to_fit();
+	if (!matchesBind) return CHANNEL_CONSTANT;
+	values[0] = bindValue;
+	return CHANNEL_STATIC;
+}
+
+// A track whose channels all match the bind pose is dropped, the bone then
+// uses its bind transform directly.
+static void ClassifyTrack(BoneTransformTrack& btt, Skeleton* skeleton, int bone)
+{
+	if (btt.positionTimestamps.empty()) return;
+	btt.positionKind = ClassifyChannel(btt.positionTimestamps, btt.positions, skeleton->bindPositions[bone], STATIC_POSITION_TOLERANCE);
+	btt.scaleKind = ClassifyChannel(btt.scaleTimestamps, btt.scales, skeleton->bindScales[bone], STATIC_SCALE_TOLERANCE);
+	if (!btt.rotations.empty())
+	{
+		btt.rotationKind = ClassifyChannel(btt.rotationTimestamps, btt.rotations, skeleton->bindRotations[bone], STATIC_ROTATION_TOLERANCE);
+	}
+
+	if (btt.positionKind == CHANNEL_STATIC && btt.rotationKind == CHANNEL_STATIC && btt.scaleKind == CHANNEL_STATIC)
+	{
+		btt = {};
+	}
+}
+
+// Resolve every channel to its bone id once so sampling never hashes bone names
+static void CompileAnimation(Animation* animation)
+{
+	Skeleton* skeleton = animation->skeleton.get();
+	std::unordered_map<std::string, int> boneIds;
+	for (int i = 0; i < skeleton->count; i++)
+	{
+		boneIds[skeleton->names[i]] = i;
+	}
+
+	animation->tracks.clear();
+	animation->tracks.resize(skeleton->count);
+	for (auto& channel : animation->boneTransforms)
+	{
+		auto boneId = boneIds.find(channel.first);
+		if (boneId == boneIds.end()) continue;
+		animation->tracks[boneId->second] = std::move(channel.second);
+		ClassifyTrack(animation->tracks[boneId->second], skeleton, boneId->second);
+	}
+	animation->boneTransforms.clear();
+}
+
+// Every clip of the scene with its channels still keyed by node name
+static std::vector<Animation> ReadAnimations(const aiScene* scene)
+{
+	std::vector<Animation> animations;
+	aiAnimation** animationInfos = scene->mAnimations;
+
+	for (int i = 0; i < scene->mNumAnimations; i++)
+	{
+		aiAnimation* anim = animationInfos[i];
+		Animation animation = {};
+		animation.duration = anim->mDuration;
+		animation.ticksPersecond = anim->mTicksPerSecond;
+		animation.globalInverseTransform = glm::inverse(ConvertAssimpToGLM(scene->mRootNode->mTransformation));
+		animation.name = anim->mName.C_Str();
+
+		for (int j = 0; j < anim->mNumChannels; j++)
+		{
+			aiNodeAnim* channel = anim->mChannels[j];
+			BoneTransformTrack track;
+			for (int k = 0; k < channel->mNumPositionKeys; k++)
+			{
+				track.positionTimestamps.push_back(channel->mPositionKeys[k].mTime);
+				track.positions.push_back(ConvertAssimpToGLM(channel->mPositionKeys[k].mValue));
+			}
+
+			for (int k = 0; k < channel->mNumRotationKeys; k++)
+			{
+				track.rotationTimestamps.push_back(channel->mRotationKeys[k].mTime);
+				track.rotations.push_back(ConvertAssimpToGLM(channel->mRotationKeys[k].mValue));
+			}
+
+			for (int k = 0; k < channel->mNumScalingKeys; k++)
+			{
+				track.scaleTimestamps.push_back(channel->mScalingKeys[k].mTime);
+				track.scales.push_back(ConvertAssimpToGLM(channel->mScalingKeys[k].mValue));
+			}
+			animation.boneTransforms[channel->mNodeName.C_Str()] = track;
+		}
+		animations.push_back(animation);
+	}
+	return animations;
+}
+
+// Bind clips read by ReadAnimations to a skeleton by bone name. Clips already
+// compiled against skeleton, like those of a cached asset, are kept as they are.
+static void BindAnimations(std::vector<Animation>& animations, std::shared_ptr<Skeleton> skeleton)
+{
+	for (int i = 0; i < animations.size(); i++)
+	{
+		if (animations[i].skeleton == skeleton) continue;
+		animations[i].boneCount = skeleton->count;
+		animations[i].skeleton = skeleton;
+		CompileAnimation(&animations[i]);
+	}
+}
+
+// Load every clip of the scene and bind it to an already built skeleton by bone name
+static std::vector<Animation> LoadAnimations(const aiScene* scene, std::shared_ptr<Skeleton> skeleton)
+{
+	std::vector<Animation> animations = ReadAnimations(scene);
+	BindAnimations(animations, skeleton);
+	return animations;
+}
+
+static std::vector<Animation> LoadAnimations(const aiScene* scene, MeshData* meshData)
+{
+	std::shared_ptr<Skeleton> skeleton = std::make_shared<Skeleton>();
+	LoadBoneData(scene, meshData, skeleton.get());
+	return LoadAnimations(scene, skeleton);
+}
+
+#define MAX_CURSOR_STEPS 4
+
+// Find the key segment containing dt. Forward playback only moves a key or two
+// per frame, so search forward from the cursor first and fall back to a binary
+// search after a seek or when the clip loops.
+static std::pair<int, float> GetTimeFraction(std::vector<float>& times, float& dt, int& cursor)
+{
+	int last = (int)times.size() - 1;
+	if (last < 1)
+	{
+		cursor = 0;
+		return { 0, 0.0f };
+	}
+
+	int segment = cursor;
+	if (segment < 1 || segment > last || dt < times[segment - 1])
+	{
+		segment = std::upper_bound(times.begin(), times.end(), dt) - times.begin();
+	}
+	else
+	{
+		for (int i = 0; i < MAX_CURSOR_STEPS && segment < last && dt >= times[segment]; i++)
+		{
+			segment++;
+		}
+
+		if (segment < last && dt >= times[segment])
+		{
+			segment = std::upper_bound(times.begin() + segment, times.end(), dt) - times.begin();
+		}
+	}
+
+	segment = std::clamp(segment, 1, last);
+	cursor = segment;
+	float start = times[segment - 1];
+	float end = times[segment];
+	float frac = glm::clamp((dt - start) / (end - start), 0.0f, 1.0f);
+	return { segment, frac };
+}
+
+
+static glm::quat UnpackRotation(PackedQuat packed)
+{
+	unsigned long long bits = ((unsigned long long)packed.data[0] << 32) | ((unsigned long long)packed.data[1] << 16) | packed.data[2];
+	int largest = (bits >> 45) & 3;
+	glm::quat rotation;
+	float sum = 0.0f;
+	for (int k = 3, shift = 30; k >= 0; k--)
+	{
+		if (k == largest) continue;
+		float value = ((bits >> shift) & 0x7fff) / 32767.0f * 2.0f - 1.0f;
+		rotation[k] = value * 0.70710678f;
+		sum += rotation[k] * rotation[k];
+		shift -= 15;
+	}
+	rotation[largest] = std::sqrt(std::max(1.0f - sum, 0.0f));
+	return rotation;
+}
+
+static glm::quat GetTrackRotation(BoneTransformTrack& btt, int key)
+{
+	if (btt.packedRotations.empty()) return btt.rotations[key];
+	return UnpackRotation(btt.packedRotations[key]);
+}
+
+// rotations closer than this (cosine of half the angle) blend with nlerp
+#define NLERP_THRESHOLD 0.998f
+
+template <int Kind>
+static glm::vec3 SampleChannel(std::vector<float>& timestamps, std::vector<glm::vec3>& values, float dt, int& cursor)
+{
+	if (Kind != CHANNEL_ANIMATED) return values[0];
+	std::pair<int, float> fp = GetTimeFraction(timestamps, dt, cursor);
+	return glm::mix(values[std::max(fp.first - 1, 0)], values[fp.first], fp.second);
+}
+
+template <int Kind>
+static glm::quat SampleRotationChannel(BoneTransformTrack& btt, float dt, int& cursor)
+{
+	if (Kind != CHANNEL_ANIMATED) return GetTrackRotation(btt, 0);
+	std::pair<int, float> fp = GetTimeFraction(btt.rotationTimestamps, dt, cursor);
+	glm::quat rotation1 = GetTrackRotation(btt, std::max(fp.first - 1, 0));
+	glm::quat rotation2 = GetTrackRotation(btt, fp.first);
+
+	float d = glm::dot(rotation1, rotation2);
+	if (std::fabs(d) < NLERP_THRESHOLD)
+	{
+		return glm::slerp(rotation1, rotation2, fp.second);
+	}
+	float t2 = d < 0.0f ? -fp.second : fp.second;
+	return glm::normalize(rotation1 * (1.0f - fp.second) + rotation2 * t2);
+}
+
+// translate * rotate * scale, built directly instead of multiplying three matrices
+template <int PositionKind, int RotationKind, int ScaleKind>
+static glm::mat4 SampleChannels(BoneTransformTrack& btt, TrackCursor& cursor, float dt)
+{
+	glm::vec3 position = SampleChannel<PositionKind>(btt.positionTimestamps, btt.positions, dt, cursor.position);
+	glm::quat rotation = SampleRotationChannel<RotationKind>(btt, dt, cursor.rotation);
+	glm::vec3 scale = SampleChannel<ScaleKind>(btt.scaleTimestamps, btt.scales, dt, cursor.scale);
+
+	glm::mat4 transform = glm::toMat4(rotation);
+	transform[0] *= scale.x;
+	transform[1] *= scale.y;
+	transform[2] *= scale.z;
+	transform[3] = glm::vec4(position, 1.0f);
+	return transform;
+}
+
+typedef glm::mat4 (*TrackSampler)(BoneTransformTrack&, TrackCursor&, float);
+
+#define TRACK_SAMPLERS(p, r) SampleChannels<p, r, CHANNEL_ANIMATED>, SampleChannels<p, r, CHANNEL_CONSTANT>, SampleChannels<p, r, CHANNEL_STATIC>
+
+// indexed by (positionKind * 3 + rotationKind) * 3 + scaleKind
+static const TrackSampler trackSamplers[27] = {
+	TRACK_SAMPLERS(CHANNEL_ANIMATED, CHANNEL_ANIMATED), TRACK_SAMPLERS(CHANNEL_ANIMATED, CHANNEL_CONSTANT), TRACK_SAMPLERS(CHANNEL_ANIMATED, CHANNEL_STATIC),
+	TRACK_SAMPLERS(CHANNEL_CONSTANT, CHANNEL_ANIMATED), TRACK_SAMPLERS(CHANNEL_CONSTANT, CHANNEL_CONSTANT), TRACK_SAMPLERS(CHANNEL_CONSTANT, CHANNEL_STATIC),
+	TRACK_SAMPLERS(CHANNEL_STATIC, CHANNEL_ANIMATED), TRACK_SAMPLERS(CHANNEL_STATIC, CHANNEL_CONSTANT), TRACK_SAMPLERS(CHANNEL_STATIC, CHANNEL_STATIC),
+};
+
+static glm::mat4 SampleTrack(BoneTransformTrack& btt, TrackCursor& cursor, float dt)
+{
+	return trackSamplers[(btt.positionKind * 3 + btt.rotationKind) * 3 + btt.scaleKind](btt, cursor, dt);
+}
+
+// reduced skips the tracks of detail bones, they follow their parent rigidly
+static void GetPose(AnimationInstance* instance, float dt, bool reduced = false)
+{
+	Animation* animation = instance->animation;
+	Skeleton* skeleton = animation->skeleton.get();
+	std::vector<glm::mat4>& pose = instance->pose;
+	instance->time = dt;
+	dt = fmod(dt, animation->duration);
+
+	// parents come first, so a single pass accumulates the global transforms
+	for (int i = 0; i < skeleton->count; i++)
+	{
+		glm::mat4 localTransform = skeleton->bindTransforms[i];
+		BoneTransformTrack& btt = animation->tracks[i];
+		if (!btt.positionTimestamps.empty() && !(reduced && skeleton->detailBones[i]))
+		{
+			localTransform = SampleTrack(btt, instance->cursors[i], dt);
+		}
+
+		int parent = skeleton->parents[i];
+		pose[i] = parent < 0 ? localTransform : pose[parent] * localTransform;
+	}
+
+	for (int i = 0; i < skeleton->count; i++)
+	{
+		pose[i] = animation->globalInverseTransform * pose[i] * skeleton->offsets[i];
+	}
+}
+
+// Animation instance
+static void BindAnimationInstance(AnimationInstance* instance, Animation* animation)
+{
+	instance->animation = animation;
+	instance->time = 0;
+	int boneCount = animation ? animation->boneCount : 0;
+	instance->pose.assign(boneCount, glm::mat4(1.0f));
+	instance->cursors.assign(boneCount, {});
+}
+
+static int CreateAnimationInstance(AnimationInstancePool* pool, Animation* animation)
+{
+	int handle;
+	if (pool->freeList.size() > 0)
+	{
+		handle = pool->freeList.back();
+		pool->freeList.pop_back();
+	}
+	else
+	{
+		handle = pool->instances.size();
+		pool->instances.push_back({});
+	}
+
+	BindAnimationInstance(&pool->instances[handle], animation);
+	pool->count++;
+	return handle;
+}
+
+static void DestroyAnimationInstance(AnimationInstancePool* pool, int handle)
+{
+	if (handle < 0 || handle >= pool->instances.size()) return;
+	BindAnimationInstance(&pool->instances[handle], nullptr);
+	pool->freeList.push_back(handle);
+	pool->count--;
+}
+
+#define BAKED_PALETTE_TEXTURE_UNIT 7
+
+// Sample the clip with GetPose at a fixed rate and upload every frame into
+// bakedPalette, the skinning shader interpolates between neighbouring frames.
+static void BakeAnimation(Animation* animation, int framesPerSecond = 30)
+{
+	int boneCount = animation->boneCount;
+	float seconds = animation->duration / GetTicksPerSecond(animation);
+	int frameCount = std::max((int)std::ceil(seconds * framesPerSecond), 1) + 1;
+	std::vector<glm::vec4> texels(boneCount * 3 * frameCount);
+
+	AnimationInstance instance = {};
+	BindAnimationInstance(&instance, animation);
+	for (int frame = 0; frame < frameCount; frame++)
+	{
+		// the last frame is sampled just before the clip wraps around
+		float time = animation->duration * frame / (frameCount - 1);
+		GetPose(&instance, std::min(time, std::nextafter(animation->duration, 0.0f)));
+		for (int i = 0; i < boneCount; i++)
+		{
+			glm::mat4 rows = glm::transpose(instance.pose[i]);
+			for (int k = 0; k < 3; k++)
+			{
+				texels[(frame * boneCount + i) * 3 + k] = rows[k];
+			}
+		}
+	}
+
+	Texture* texture = &animation->bakedPalette;
+	if (texture->id) glDeleteTextures(1, &texture->id);
+	texture->name = animation->name + "_palette";
+	texture->width = boneCount * 3;
+	texture->height = frameCount;
+	// direct state access, baking lazily mid frame must not disturb the bound textures
+	glCreateTextures(GL_TEXTURE_2D, 1, &texture->id);
+	glTextureStorage2D(texture->id, 1, GL_RGBA32F, texture->width, texture->height);
+	glTextureSubImage2D(texture->id, 0, 0, 0, texture->width, texture->height, GL_RGBA, GL_FLOAT, texels.data());
+	glTextureParameteri(texture->id, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(texture->id, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(texture->id, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTextureParameteri(texture->id, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+static void WaitBonePaletteFence(BonePaletteBuffer* palette, int region)
+{
+	GLsync& fence = palette->fences[region];
+	if (!fence) return;
+	while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+	glDeleteSync(fence);
+	fence = 0;
+}
+
+static void InitBonePaletteBuffer(BonePaletteBuffer* palette, int capacity)
+{
+	palette->capacity = capacity;
+	palette->region = 0;
+	palette->used = 0;
+	palette->inFrame = false;
+	for (int i = 0; i < BONE_PALETTE_REGIONS; i++)
+	{
+		palette->fences[i] = 0;
+	}
+
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	GLsizeiptr size = (GLsizeiptr)capacity * BONE_PALETTE_REGIONS * sizeof(glm::vec4);
+	glCreateBuffers(1, &palette->buffer);
+	glNamedBufferStorage(palette->buffer, size, nullptr, flags);
+	palette->mapped = (glm::vec4*)glMapNamedBufferRange(palette->buffer, 0, size, flags);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BONE_PALETTE_BINDING, palette->buffer);
+}
+
+static void DestroyBonePaletteBuffer(BonePaletteBuffer* palette)
+{
+	for (int i = 0; i < BONE_PALETTE_REGIONS; i++)
+	{
+		WaitBonePaletteFence(palette, i);
+	}
+	glUnmapNamedBuffer(palette->buffer);
+	glDeleteBuffers(1, &palette->buffer);
+	palette->buffer = 0;
+	palette->mapped = nullptr;
+}
+
+// Start writing the palettes of a frame. The previous frame's draws have been
+// issued by now, so its region is fenced and the next one is waited on.
+static void BeginBonePaletteFrame(BonePaletteBuffer* palette, int entryCount)
+{
+	if (palette->inFrame)
+	{
+		palette->fences[palette->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		palette->region = (palette->region + 1) % BONE_PALETTE_REGIONS;
+	}
+
+	if (entryCount > palette->capacity)
+	{
+		DestroyBonePaletteBuffer(palette);
+		InitBonePaletteBuffer(palette, std::max(entryCount, palette->capacity * 2));
+	}
+
+	WaitBonePaletteFence(palette, palette->region);
+	palette->used = 0;
+	palette->inFrame = true;
+}
+
+static int GetPaletteStride(int format)
+{
+	switch (format)
+	{
+	case PALETTE_AFFINE: return 3;
+	case PALETTE_DUAL_QUATERNION: return 2;
+	default: return 4;
+	}
+}
+
+// Convert pose matrices to the palette format, the vertex shader undoes this
+static void WritePaletteEntries(glm::vec4* output, const glm::mat4* pose, int count, int format)
+{
+	for (int i = 0; i < count; i++)
+	{
+		const glm::mat4& transform = pose[i];
+		switch (format)
+		{
+		case PALETTE_AFFINE:
+		{
+			glm::mat4 rows = glm::transpose(transform);
+			output[i * 3 + 0] = rows[0];
+			output[i * 3 + 1] = rows[1];
+			output[i * 3 + 2] = rows[2];
+			break;
+		}
+		case PALETTE_DUAL_QUATERNION:
+		{
+			glm::quat real = glm::normalize(glm::quat_cast(glm::mat3(transform)));
+			glm::vec3 t = glm::vec3(transform[3]);
+			glm::quat dual = glm::quat(0.0f, t.x, t.y, t.z) * real * 0.5f;
+			output[i * 2 + 0] = glm::vec4(real.x, real.y, real.z, real.w);
+			output[i * 2 + 1] = glm::vec4(dual.x, dual.y, dual.z, dual.w);
+			break;
+		}
+		default:
+		{
+			for (int k = 0; k < 4; k++)
+			{
+				output[i * 4 + k] = transform[k];
+			}
+			break;
+		}
+		}
+	}
+}
+
+// write a pose into the current region, returns the entry offset the shader reads it from
+static int AllocateBonePalette(BonePaletteBuffer* palette, const glm::mat4* pose, int count)
+{
+	int entries = count * GetPaletteStride(palette->format);
+	if (palette->used + entries > palette->capacity)
+	{
+		std::cout << "Bone palette buffer is full" << std::endl;
+		return 0;
+	}
+	int offset = palette->region * palette->capacity + palette->used;
+	WritePaletteEntries(palette->mapped + offset, pose, count, palette->format);
+	palette->used += entries;
+	return offset;
+}
+
+static int GetSkinStride(int indexBits, int weightBits)
+{
+	return MAX_BONE_INFLUENCE * (indexBits + weightBits) / 8;
+}
+
+template <typename T>
+static void WritePackedIds(unsigned char* output, VertexData& vertex)
+{
+	T* ids = (T*)output;
+	for (int k = 0; k < MAX_BONE_INFLUENCE; k++)
+	{
+		ids[k] = vertex.animated.weights[k] > 0.0f ? (T)vertex.animated.boneIDs[k] : 0;
+	}
+}
+
+// Quantize the weights so they still sum to exactly one, the rounding error
+// goes to the heaviest influence
+template <typename T>
+static void WritePackedWeights(unsigned char* output, VertexData& vertex)
+{
+	T* weights = (T*)output;
+	int scale = (1 << (sizeof(T) * 8)) - 1;
+	int total = 0;
+	for (int k = 0; k < MAX_BONE_INFLUENCE; k++)
+	{
+		weights[k] = (T)std::lround(glm::clamp(vertex.animated.weights[k], 0.0f, 1.0f) * scale);
+		total += weights[k];
+	}
+	if (total) weights[0] = (T)(weights[0] + scale - total);
+}
+
+static std::vector<unsigned char> PackSkin(std::vector<VertexData>& vertices, int indexBits, int weightBits)
+{
+	int stride = GetSkinStride(indexBits, weightBits);
+	int weightOffset = MAX_BONE_INFLUENCE * indexBits / 8;
+	std::vector<unsigned char> skin(vertices.size() * stride, 0);
+	for (int i = 0; i < vertices.size(); i++)
+	{
+		unsigned char* output = &skin[i * stride];
+		if (indexBits == 8) WritePackedIds<unsigned char>(output, vertices[i]);
+		else WritePackedIds<unsigned short>(output, vertices[i]);
+		if (weightBits == 8) WritePackedWeights<unsigned char>(output + weightOffset, vertices[i]);
+		else WritePackedWeights<unsigned short>(output + weightOffset, vertices[i]);
+	}
+	return skin;
+}
+
+// Bone ids and weights of one vertex of a packed skin stream, the inverse of PackSkin
+static void UnpackSkin(const unsigned char* skin, int indexBits, int weightBits, int vertex, int* boneIds, float* weights)
+{
+	const unsigned char* input = skin + vertex * GetSkinStride(indexBits, weightBits);
+	const unsigned char* packedWeights = input + MAX_BONE_INFLUENCE * indexBits / 8;
+	for (int k = 0; k < MAX_BONE_INFLUENCE; k++)
+	{
+		boneIds[k] = indexBits == 8 ? input[k] : ((const unsigned short*)input)[k];
+		weights[k] = weightBits == 8 ? packedWeights[k] / 255.0f : ((const unsigned short*)packedWeights)[k] / 65535.0f;
+	}
+}
+
+// Unit vector to the octahedron, folded into [-1, 1]^2
+static glm::vec2 OctEncode(glm::vec3 v)
+{
+	float length = std::fabs(v.x) + std::fabs(v.y) + std::fabs(v.z);
+	if (length == 0.0f) return glm::vec2(0.0f);
+	glm::vec2 p = glm::vec2(v.x, v.y) / length;
+	if (v.z < 0.0f)
+	{
+		p = glm::vec2((1.0f - std::fabs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f), (1.0f - std::fabs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f));
+	}
+	return p;
+}
+
+static glm::vec3 OctDecode(glm::vec2 p)
+{
+	glm::vec3 v = glm::vec3(p.x, p.y, 1.0f - std::fabs(p.x) - std::fabs(p.y));
+	float t = std::max(-v.z, 0.0f);
+	v.x += v.x >= 0.0f ? -t : t;
+	v.y += v.y >= 0.0f ? -t : t;
+	return glm::normalize(v);
+}
+
+static void PackAttributes(unsigned int* output, MeshVertex& vertex)
+{
+	float handedness = glm::dot(glm::cross(vertex.normal, vertex.vertTangent), vertex.vertBitangent) < 0.0f ? -1.0f : 1.0f;
+	output[0] = glm::packSnorm2x16(OctEncode(vertex.normal));
+	output[1] = glm::packSnorm4x8(glm::vec4(OctEncode(vertex.vertTangent), handedness, 0.0f));
+	output[2] = glm::packHalf2x16(vertex.uv);
+}
+
+// A single white color, bound with stride 0 so every vertex of a mesh
+// without a color stream reads it
+static GLuint GetWhiteColorBuffer()
+{
+	static GLuint buffer = 0;
+	if (!buffer)
+	{
+		unsigned int white = 0xffffffff;
+		glCreateBuffers(1, &buffer);
+		glNamedBufferStorage(buffer, sizeof(white), &white, 0);
+	}
+	return buffer;
+}
+
+// Bind the streams of format to vao, the ones it leaves out stay disabled.
+// Streams is a Mesh or a MeshArena.
+template<typename Streams>
+static void SetVertexStreams(GLuint vao, Streams* streams, GLuint vertexBuffer, GLuint attributeBuffer, int format)
+{
+	glVertexArrayElementBuffer(vao, streams->indexBuffer);
+
+	glVertexArrayVertexBuffer(vao, POSITION_STREAM, vertexBuffer, 0, sizeof(glm::vec3));
+	glEnableVertexArrayAttrib(vao, 0);
+	glVertexArrayAttribFormat(vao, 0, 3, GL_FLOAT, GL_FALSE, 0);
+	glVertexArrayAttribBinding(vao, 0, POSITION_STREAM);
+
+	glVertexArrayVertexBuffer(vao, ATTRIBUTE_STREAM, attributeBuffer, 0, ATTRIBUTE_STRIDE);
+	if (format & VERTEX_NORMAL)
+	{
+		glEnableVertexArrayAttrib(vao, 1);
+		glVertexArrayAttribFormat(vao, 1, 2, GL_SHORT, GL_TRUE, 0);
+		glVertexArrayAttribBinding(vao, 1, ATTRIBUTE_STREAM);
+	}
+	if (format & VERTEX_TANGENT)
+	{
+		glEnableVertexArrayAttrib(vao, 2);
+		glVertexArrayAttribFormat(vao, 2, 4, GL_BYTE, GL_TRUE, 4);
+		glVertexArrayAttribBinding(vao, 2, ATTRIBUTE_STREAM);
+	}
+	if (format & VERTEX_UV)
+	{
+		glEnableVertexArrayAttrib(vao, 5);
+		glVertexArrayAttribFormat(vao, 5, 2, GL_HALF_FLOAT, GL_FALSE, 8);
+		glVertexArrayAttribBinding(vao, 5, ATTRIBUTE_STREAM);
+	}
+
+	if (format & VERTEX_COLOR)
+	{
+		if (streams->colorBuffer) glVertexArrayVertexBuffer(vao, COLOR_STREAM, streams->colorBuffer, 0, 4);
+		else glVertexArrayVertexBuffer(vao, COLOR_STREAM, GetWhiteColorBuffer(), 0, 0);
+		glEnableVertexArrayAttrib(vao, 4);
+		glVertexArrayAttribFormat(vao, 4, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0);
+		glVertexArrayAttribBinding(vao, 4, COLOR_STREAM);
+	}
+
+	// ids stay integers on the way to the shader, weights are normalized
+	if ((format & VERTEX_SKIN) && streams->skinBuffer)
+	{
+		GLenum indexType = streams->skinIndexBits == 8 ? GL_UNSIGNED_BYTE : GL_UNSIGNED_SHORT;
+		GLenum weightType = streams->skinWeightBits == 8 ? GL_UNSIGNED_BYTE : GL_UNSIGNED_SHORT;
+		int weightOffset = MAX_BONE_INFLUENCE * streams->skinIndexBits / 8;
+		glVertexArrayVertexBuffer(vao, SKIN_STREAM, streams->skinBuffer, 0, GetSkinStride(streams->skinIndexBits, streams->skinWeightBits));
+
+		// influences 0-3 and 4-7
+		for (int i = 0; i < 2; i++)
+		{
+			glEnableVertexArrayAttrib(vao, 6 + i * 2);
+			glVertexArrayAttribIFormat(vao, 6 + i * 2, 4, indexType, i * 4 * streams->skinIndexBits / 8);
+			glVertexArrayAttribBinding(vao, 6 + i * 2, SKIN_STREAM);
+			glEnableVertexArrayAttrib(vao, 7 + i * 2);
+			glVertexArrayAttribFormat(vao, 7 + i * 2, 4, weightType, GL_TRUE, weightOffset + i * 4 * streams->skinWeightBits / 8);
+			glVertexArrayAttribBinding(vao, 7 + i * 2, SKIN_STREAM);
+		}
+	}
+}
+
+template<typename Streams>
+static GLuint GetFormatVertexArray(Streams* streams, int format)
+{
+	auto vao = streams->formatVaos.find(format);
+	if (vao != streams->formatVaos.end()) return vao->second;
+
+	GLuint newVao;
+	glCreateVertexArrays(1, &newVao);
+	SetVertexStreams(newVao, streams, streams->vertexBuffer, streams->attributeBuffer, format);
+	streams->formatVaos[format] = newVao;
+	return newVao;
+}
+
+// Meshes in an arena share its vertex arrays
+static GLuint GetVertexArray(Mesh* mesh, int format)
+{
+	if (mesh->arena) return GetFormatVertexArray(mesh->arena, format);
+	return GetFormatVertexArray(mesh, format);
+}
+
+// Bind vao unless it is already bound, for loops drawing many meshes
+static void BindVertexArray(GLuint vao, GLuint* boundVao)
+{
+	if (*boundVao == vao) return;
+	glBindVertexArray(vao);
+	*boundVao = vao;
+}
+
+// First fit, -1 when no free range is large enough
+static int AllocateRange(std::vector<FreeRange>& freeRanges, int size)
+{
+	for (int i = 0; i < freeRanges.size(); i++)
+	{
+		if (freeRanges[i].size < size) continue;
+		int offset = freeRanges[i].offset;
+		freeRanges[i].offset += size;
+		freeRanges[i].size -= size;
+		if (!freeRanges[i].size) freeRanges.erase(freeRanges.begin() + i);
+		return offset;
+	}
+	return -1;
+}
+
+// Return a range and merge it with its free neighbours
+static void ReleaseRange(std::vector<FreeRange>& freeRanges, int offset, int size)
+{
+	if (!size) return;
+	int i = 0;
+	while (i < freeRanges.size() && freeRanges[i].offset < offset) i++;
+	freeRanges.insert(freeRanges.begin() + i, { offset, size });
+	if (i + 1 < freeRanges.size() && offset + size == freeRanges[i + 1].offset)
+	{
+		freeRanges[i].size += freeRanges[i + 1].size;
+		freeRanges.erase(freeRanges.begin() + i + 1);
+	}
+	if (i > 0 && freeRanges[i - 1].offset + freeRanges[i - 1].size == offset)
+	{
+		freeRanges[i - 1].size += freeRanges[i].size;
+		freeRanges.erase(freeRanges.begin() + i);
+	}
+}
+
+// skinIndexBits of 0 makes an arena for meshes without bone weights
+static void InitMeshArena(MeshArena* arena, int skinIndexBits)
+{
+	*arena = {};
+	glCreateBuffers(1, &arena->vertexBuffer);
+	glCreateBuffers(1, &arena->attributeBuffer);
+	glCreateBuffers(1, &arena->colorBuffer);
+	if (skinIndexBits)
+	{
+		arena->skinIndexBits = skinIndexBits;
+		arena->skinWeightBits = SKIN_WEIGHT_BITS;
+		glCreateBuffers(1, &arena->skinBuffer);
+	}
+	glCreateBuffers(1, &arena->indexBuffer);
+}
+
+// Reallocate buffer keeping its name and first size bytes, so the vertex
+// arrays and meshes holding the name stay valid
+static void ResizeBuffer(GLuint buffer, int size, int newSize)
+{
+	if (!size)
+	{
+		glNamedBufferData(buffer, newSize, nullptr, GL_STATIC_DRAW);
+		return;
+	}
+	GLuint copy;
+	glCreateBuffers(1, &copy);
+	glNamedBufferData(copy, size, nullptr, GL_STATIC_COPY);
+	glCopyNamedBufferSubData(buffer, copy, 0, 0, size);
+	glNamedBufferData(buffer, newSize, nullptr, GL_STATIC_DRAW);
+	glCopyNamedBufferSubData(copy, buffer, 0, 0, size);
+	glDeleteBuffers(1, &copy);
+}
+
+// Range of count vertices in every stream, the streams at least double when
+// no free range is large enough
+static int AllocateVertices(MeshArena* arena, int count)
+{
+	int offset = AllocateRange(arena->freeVertices, count);
+	if (offset >= 0) return offset;
+
+	int capacity = arena->vertexCapacity;
+	int newCapacity = std::max(capacity * 2, capacity + std::max(count, 1));
+	ResizeBuffer(arena->vertexBuffer, capacity * sizeof(glm::vec3), newCapacity * sizeof(glm::vec3));
+	ResizeBuffer(arena->attributeBuffer, capacity * ATTRIBUTE_STRIDE, newCapacity * ATTRIBUTE_STRIDE);
+	ResizeBuffer(arena->colorBuffer, capacity * sizeof(unsigned int), newCapacity * sizeof(unsigned int));
+	if (arena->skinBuffer)
+	{
+		int skinStride = GetSkinStride(arena->skinIndexBits, arena->skinWeightBits);
+		ResizeBuffer(arena->skinBuffer, capacity * skinStride, newCapacity * skinStride);
+	}
+	ReleaseRange(arena->freeVertices, capacity, newCapacity - capacity);
+	arena->vertexCapacity = newCapacity;
+	return AllocateRange(arena->freeVertices, count);
+}
+
+static int AllocateIndexBytes(MeshArena* arena, int size)
+{
+	int offset = AllocateRange(arena->freeIndices, size);
+	if (offset >= 0) return offset;
+
+	int capacity = arena->indexCapacity;
+	int newCapacity = std::max(capacity * 2, capacity + std::max(size, 1));
+	ResizeBuffer(arena->indexBuffer, capacity, newCapacity);
+	ReleaseRange(arena->freeIndices, capacity, newCapacity - capacity);
+	arena->indexCapacity = newCapacity;
+	return AllocateRange(arena->freeIndices, size);
+}
+
+static void DestroyMeshArena(MeshArena* arena)
+{
+	for (auto& vao : arena->formatVaos)
+	{
+		glDeleteVertexArrays(1, &vao.second);
+	}
+	glDeleteBuffers(1, &arena->vertexBuffer);
+	glDeleteBuffers(1, &arena->attributeBuffer);
+	glDeleteBuffers(1, &arena->colorBuffer);
+	glDeleteBuffers(1, &arena->skinBuffer);
+	glDeleteBuffers(1, &arena->indexBuffer);
+	*arena = {};
+}
+
+// Index ranges keep every offset 4 byte aligned
+static int GetIndexBytes(Mesh* mesh)
+{
+	int indexSize = mesh->indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+	return (mesh->indexCount * indexSize + 3) & ~3;
+}
+
+// Free the buffers of a mesh, or its ranges when it lives in an arena
+static void DestroyMesh(Mesh* mesh)
+{
+	if (mesh->arena)
+	{
+		ReleaseRange(mesh->arena->freeVertices, mesh->baseVertex, mesh->vertexCount);
+		ReleaseRange(mesh->arena->freeIndices, mesh->indexOffset, GetIndexBytes(mesh));
+	}
+	else
+	{
+		glDeleteVertexArrays(1, &mesh->vao);
+		glDeleteBuffers(1, &mesh->vertexBuffer);
+		glDeleteBuffers(1, &mesh->indexBuffer);
+		glDeleteBuffers(1, &mesh->skinBuffer);
+		glDeleteBuffers(1, &mesh->attributeBuffer);
+		glDeleteBuffers(1, &mesh->colorBuffer);
+		for (auto& vao : mesh->formatVaos)
+		{
+			glDeleteVertexArrays(1, &vao.second);
+		}
+	}
+	mesh->arena = nullptr;
+}
+
+static void AddMultiDraw(MultiDraw* draw, unsigned int count, size_t offset, int baseVertex, int material)
+{
+	if (!count) return;
+	draw->counts.push_back(count);
+	draw->offsets.push_back((const void*)offset);
+	draw->baseVertices.push_back(baseVertex);
+	draw->materials.push_back(material);
+}
+
+// Every draw, or only the run of one material slot
+static void MultiDrawMesh(Mesh* mesh, MultiDraw* draw, int material = -1)
+{
+	int first = 0;
+	int count = draw->counts.size();
+	if (material >= 0)
+	{
+		auto run = std::equal_range(draw->materials.begin(), draw->materials.end(), material);
+		first = run.first - draw->materials.begin();
+		count = run.second - run.first;
+	}
+	if (!count) return;
+	glMultiDrawElementsBaseVertex(GL_TRIANGLES, draw->counts.data() + first, mesh->indexType, draw->offsets.data() + first, count, draw->baseVertices.data() + first);
+}
+
+// Pack meshData into the streams InitMesh uploads. Runs on any thread, the
+// asset cache stores the result so cached loads skip this.
+static PackedMesh PackMesh(MeshData* meshData)
+{
+	unsigned int vertexCount = meshData->vertices.size();
+	VertexData* vertices = meshData->vertices.data();
+	InitSubmeshes(meshData);
+
+	PackedMesh packed = {};
+	packed.submeshes = meshData->submeshes;
+	packed.indexCount = meshData->indices.size();
+
+	// indices are local to their submesh, 16 bits cover most meshes
+	int maxSubmeshVertices = 0;
+	for (int i = 0; i < packed.submeshes.size(); i++)
+	{
+		maxSubmeshVertices = std::max(maxSubmeshVertices, packed.submeshes[i].vertexCount);
+	}
+	packed.indexType = maxSubmeshVertices <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	if (packed.indexType == GL_UNSIGNED_SHORT)
+	{
+		std::vector<unsigned short> shortIndices(meshData->indices.begin(), meshData->indices.end());
+		packed.indices.assign((unsigned char*)shortIndices.data(), (unsigned char*)(shortIndices.data() + shortIndices.size()));
+	}
+	else
+	{
+		packed.indices.assign((unsigned char*)meshData->indices.data(), (unsigned char*)(meshData->indices.data() + meshData->indices.size()));
+	}
+
+	glm::vec3 boundsMin = glm::vec3(FLT_MAX);
+	glm::vec3 boundsMax = glm::vec3(-FLT_MAX);
+	packed.positions.resize(vertexCount);
+	packed.attributes.resize(vertexCount * ATTRIBUTE_STRIDE / 4);
+	std::vector<unsigned int> colors(vertexCount);
+	bool white = true;
+	int maxBoneId = -1;
+	for (int i = 0; i < vertexCount; i++)
+	{
+		packed.positions[i] = vertices[i].mesh.position;
+		boundsMin = glm::min(boundsMin, vertices[i].mesh.position);
+		boundsMax = glm::max(boundsMax, vertices[i].mesh.position);
+		PackAttributes(&packed.attributes[i * ATTRIBUTE_STRIDE / 4], vertices[i].mesh);
+		colors[i] = glm::packUnorm4x8(glm::vec4(vertices[i].mesh.color, 1.0f));
+		white = white && vertices[i].mesh.color == glm::vec3(1.0f);
+		for (int k = 0; k < MAX_BONE_INFLUENCE && vertices[i].animated.weights[k] > 0.0f; k++)
+		{
+			maxBoneId = std::max(maxBoneId, vertices[i].animated.boneIDs[k]);
+		}
+	}
+	packed.boundsCenter = vertexCount ? (boundsMin + boundsMax) * 0.5f : glm::vec3(0.0f);
+	packed.boundsRadius = vertexCount ? glm::length(boundsMax - boundsMin) * 0.5f : 0.0f;
+	if (!white) packed.colors = colors;
+
+	if (maxBoneId >= 0)
+	{
+		packed.skinIndexBits = maxBoneId < 256 ? 8 : 16;
+		packed.skinWeightBits = SKIN_WEIGHT_BITS;
+		packed.skin = PackSkin(meshData->vertices, packed.skinIndexBits, packed.skinWeightBits);
+	}
+	return packed;
+}
+
+// Upload packed into ranges of arena, growing it when it is full. Meshes get
+// buffers of their own when arena is nullptr or holds another skin layout.
+static void UploadMesh(std::string name, Mesh* mesh, PackedMesh* packed, MeshArena* arena = nullptr)
+{
+	unsigned int indexCount = packed->indexCount;
+	int vertexCount = packed->positions.size();
 
 	*mesh = {};
-	mesh->indexCount = indexCount;
-	mesh->vertices = meshData->vertices;
 	mesh->name = name;
+	mesh->indexCount = indexCount;
+	mesh->indexType = packed->indexType;
+	mesh->submeshes = packed->submeshes;
+	mesh->vertexCount = vertexCount;
+	mesh->positions = packed->positions;
+	mesh->skin = packed->skin;
+	mesh->skinIndexBits = packed->skinIndexBits;
+	mesh->skinWeightBits = packed->skinWeightBits;
+	mesh->boundsCenter = packed->boundsCenter;
+	mesh->boundsRadius = packed->boundsRadius;
+	int indexSize = mesh->indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+
+	if (arena)
+	{
+		bool fits = packed->skin.empty() ? !arena->skinBuffer
+			: arena->skinBuffer && packed->skinIndexBits == arena->skinIndexBits && packed->skinWeightBits == arena->skinWeightBits;
+		if (fits)
+		{
+			mesh->arena = arena;
+			mesh->baseVertex = AllocateVertices(arena, vertexCount);
+			mesh->indexOffset = AllocateIndexBytes(arena, GetIndexBytes(mesh));
+		}
+		else
+		{
+			std::cout << name << ": skin layout differs from the mesh arena, using separate buffers" << std::endl;
+		}
+	}
 
-	// generate buffers
-	glGenBuffers(1, &mesh->vertexBuffer);
-	glGenVertexArrays(1, &mesh->vao);
+	// draws go in material slot order, so every slot is one run
+	mesh->materialCount = GetMaterialCount(mesh->submeshes);
+	std::vector<int> drawOrder(mesh->submeshes.size());
+	for (int i = 0; i < drawOrder.size(); i++)
+	{
+		drawOrder[i] = i;
+	}
+	std::stable_sort(drawOrder.begin(), drawOrder.end(), [mesh](int a, int b) {
+		return mesh->submeshes[a].material < mesh->submeshes[b].material;
+	});
 
-	// bind vertex array
-	glBindBuffer(GL_ARRAY_BUFFER, mesh->vertexBuffer);
-	glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(VertexData), vertices, GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	for (int i : drawOrder)
+	{
+		Submesh& submesh = mesh->submeshes[i];
+		int baseVertex = mesh->baseVertex + submesh.baseVertex;
+		AddMultiDraw(&mesh->draws, submesh.indexCount, mesh->indexOffset + submesh.firstIndex * indexSize, baseVertex, submesh.material);
 
+		// submeshes that were never bucketed draw everything with the full variant
+		unsigned int bucketed = 0;
+		for (int b = 0; b < INFLUENCE_BUCKET_COUNT; b++)
+		{
+			bucketed += submesh.influenceCounts[b];
+		}
+		if (bucketed != submesh.indexCount)
+		{
+			AddMultiDraw(&mesh->influenceDraws[INFLUENCE_BUCKET_COUNT - 1], submesh.indexCount, mesh->indexOffset + submesh.firstIndex * indexSize, baseVertex, submesh.material);
+			continue;
+		}
+		unsigned int offset = submesh.firstIndex;
+		for (int b = 0; b < INFLUENCE_BUCKET_COUNT; b++)
+		{
+			AddMultiDraw(&mesh->influenceDraws[b], submesh.influenceCounts[b], mesh->indexOffset + offset * indexSize, baseVertex, submesh.material);
+			offset += submesh.influenceCounts[b];
+		}
+	}
 
-	glGenBuffers(1, &mesh->indexBuffer);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->indexBuffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned short), indices, GL_STATIC_DRAW);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	if (mesh->arena)
+	{
+		// the streams are the arena's, shared vertex arrays always read colors
+		mesh->vertexBuffer = arena->vertexBuffer;
+		mesh->attributeBuffer = arena->attributeBuffer;
+		mesh->colorBuffer = arena->colorBuffer;
+		mesh->indexBuffer = arena->indexBuffer;
+		glNamedBufferSubData(arena->vertexBuffer, mesh->baseVertex * sizeof(glm::vec3), vertexCount * sizeof(glm::vec3), packed->positions.data());
+		glNamedBufferSubData(arena->attributeBuffer, mesh->baseVertex * ATTRIBUTE_STRIDE, packed->attributes.size() * sizeof(unsigned int), packed->attributes.data());
+		if (packed->colors.empty())
+		{
+			unsigned int white = 0xffffffff;
+			glClearNamedBufferSubData(arena->colorBuffer, GL_RGBA8, mesh->baseVertex * sizeof(unsigned int), vertexCount * sizeof(unsigned int), GL_RGBA, GL_UNSIGNED_BYTE, &white);
+		}
+		else
+		{
+			glNamedBufferSubData(arena->colorBuffer, mesh->baseVertex * sizeof(unsigned int), vertexCount * sizeof(unsigned int), packed->colors.data());
+		}
+		glNamedBufferSubData(arena->indexBuffer, mesh->indexOffset, packed->indices.size(), packed->indices.data());
 
-	glBindVertexArray(mesh->vao);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->indexBuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh->vertexBuffer);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexData), (const void*)offsetof(VertexData, VertexData::mesh.position));
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VertexData), (const void*)offsetof(VertexData, VertexData::mesh.normal));
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(VertexData), (const void*)offsetof(VertexData, VertexData::mesh.vertTangent));
-	glEnableVertexAttribArray(3);
-	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(VertexData), (const void*)offsetof(VertexData, VertexData::mesh.vertBitangent));
-	glEnableVertexAttribArray(4);
-	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(VertexData), (const void*)offsetof(VertexData, VertexData::mesh.color));
-	glEnableVertexAttribArray(5);
-	glVertexAttribPointer(5, 2, GL_FLOAT, GL_FALSE, sizeof(VertexData), (const void*)offsetof(VertexData, VertexData::mesh.uv));
-	
-	glEnableVertexAttribArray(6);
-	glVertexAttribPointer(6, 4, GL_FLOAT, GL_INT, sizeof(VertexData), (const void*)offsetof(VertexData, VertexData::animated.boneIDs));
-	glEnableVertexAttribArray(7);
-	glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(VertexData), (const void*)offsetof(VertexData, VertexData::animated.weights));
-	
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		if (arena->skinBuffer)
+		{
+			mesh->skinBuffer = arena->skinBuffer;
+			int skinStride = GetSkinStride(mesh->skinIndexBits, mesh->skinWeightBits);
+			glNamedBufferSubData(arena->skinBuffer, mesh->baseVertex * skinStride, packed->skin.size(), packed->skin.data());
+		}
+		mesh->vao = GetVertexArray(mesh, VERTEX_ALL);
+		return;
+	}
+
+	glCreateBuffers(1, &mesh->vertexBuffer);
+	glNamedBufferData(mesh->vertexBuffer, vertexCount * sizeof(glm::vec3), packed->positions.data(), GL_STATIC_DRAW);
+	glCreateBuffers(1, &mesh->attributeBuffer);
+	glNamedBufferData(mesh->attributeBuffer, packed->attributes.size() * sizeof(unsigned int), packed->attributes.data(), GL_STATIC_DRAW);
+	if (!packed->colors.empty())
+	{
+		glCreateBuffers(1, &mesh->colorBuffer);
+		glNamedBufferData(mesh->colorBuffer, packed->colors.size() * sizeof(unsigned int), packed->colors.data(), GL_STATIC_DRAW);
+	}
+
+	if (!packed->skin.empty())
+	{
+		glCreateBuffers(1, &mesh->skinBuffer);
+		glNamedBufferData(mesh->skinBuffer, packed->skin.size(), packed->skin.data(), GL_STATIC_DRAW);
+	}
+
+	glCreateBuffers(1, &mesh->indexBuffer);
+	glNamedBufferData(mesh->indexBuffer, packed->indices.size(), packed->indices.data(), GL_STATIC_DRAW);
+
+	glCreateVertexArrays(1, &mesh->vao);
+	SetVertexStreams(mesh->vao, mesh, mesh->vertexBuffer, mesh->attributeBuffer, VERTEX_ALL);
+}
+
+// Pack and upload in one go, for meshes built at runtime
+static void InitMesh(std::string name, Mesh* mesh, MeshData* meshData, MeshArena* arena = nullptr)
+{
+	PackedMesh packed = PackMesh(meshData);
+	UploadMesh(name, mesh, &packed, arena);
 }
 
 static void DrawMesh(Mesh* mesh)
 {
 	glBindVertexArray(mesh->vao);
-	glDrawElements(GL_TRIANGLES, mesh->indexCount, GL_UNSIGNED_SHORT, 0);
+	MultiDrawMesh(mesh, &mesh->draws);
 	glBindVertexArray(0);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
+// Draw with only the streams program reads. Consecutive meshes of an arena
+// share the vertex array, the caller unbinds boundVao after the last draw.
+// material limits the draw to one material slot.
+static void DrawMesh(Mesh* mesh, ShaderProgram* program, GLuint* boundVao, int material = -1)
+{
+	BindVertexArray(GetVertexArray(mesh, program->vertexFormat), boundVao);
+	MultiDrawMesh(mesh, &mesh->draws, material);
+}
+
+// Draw every influence bucket with the variant of program compiled for it
+static void DrawInfluenceBuckets(Mesh* mesh, ShaderProgram* program, GLuint* boundVao, int material = -1)
+{
+	BindVertexArray(GetVertexArray(mesh, program->vertexFormat), boundVao);
+	for (int i = 0; i < INFLUENCE_BUCKET_COUNT; i++)
+	{
+		if (mesh->influenceDraws[i].counts.empty()) continue;
+		glUseProgram(GetInfluenceVariant(program, i));
+		MultiDrawMesh(mesh, &mesh->influenceDraws[i], material);
+	}
+	glUseProgram(program->shaderProgram);
+}
+
+static void DestroySkinnedMesh(SkinnedMesh* skinnedMesh)
+{
+	if (skinnedMesh->arena)
+	{
+		ReleaseRange(skinnedMesh->arena->freeVertices, skinnedMesh->baseVertex, skinnedMesh->vertexCount);
+	}
+	else
+	{
+		glDeleteVertexArrays(1, &skinnedMesh->vao);
+		glDeleteBuffers(1, &skinnedMesh->vertexBuffer);
+		glDeleteBuffers(1, &skinnedMesh->attributeBuffer);
+	}
+	*skinnedMesh = {};
+}
+
+static void InitSkinnedMesh(SkinnedMesh* skinnedMesh, Mesh* source)
+{
+	if (skinnedMesh->source) DestroySkinnedMesh(skinnedMesh);
+	skinnedMesh->source = source;
+
+	int vertexCount = source->vertexCount;
+	skinnedMesh->vertexCount = vertexCount;
+	MeshArena* arena = source->arena;
+	if (arena)
+	{
+		int baseVertex = AllocateVertices(arena, vertexCount);
+		// output next to the source, drawn with the vertex arrays of the arena
+		skinnedMesh->arena = arena;
+		skinnedMesh->baseVertex = baseVertex;
+		skinnedMesh->vertexBuffer = arena->vertexBuffer;
+		skinnedMesh->attributeBuffer = arena->attributeBuffer;
+		// colors are not skinned, a copy keeps them at the same vertices
+		glCopyNamedBufferSubData(arena->colorBuffer, arena->colorBuffer, source->baseVertex * sizeof(unsigned int), baseVertex * sizeof(unsigned int), vertexCount * sizeof(unsigned int));
+		skinnedMesh->vao = GetFormatVertexArray(arena, VERTEX_ALL & ~VERTEX_SKIN);
+	}
+	else
+	{
+		glCreateBuffers(1, &skinnedMesh->vertexBuffer);
+		glNamedBufferData(skinnedMesh->vertexBuffer, vertexCount * sizeof(glm::vec3), nullptr, GL_DYNAMIC_COPY);
+		glCreateBuffers(1, &skinnedMesh->attributeBuffer);
+		glNamedBufferData(skinnedMesh->attributeBuffer, vertexCount * ATTRIBUTE_STRIDE, nullptr, GL_DYNAMIC_COPY);
+
+		// already skinned, everything but the skin stream
+		glCreateVertexArrays(1, &skinnedMesh->vao);
+		SetVertexStreams(skinnedMesh->vao, source, skinnedMesh->vertexBuffer, skinnedMesh->attributeBuffer, VERTEX_ALL & ~VERTEX_SKIN);
+	}
+
+	skinnedMesh->draws = source->draws;
+	for (int i = 0; i < skinnedMesh->draws.baseVertices.size(); i++)
+	{
+		skinnedMesh->draws.baseVertices[i] += skinnedMesh->baseVertex - source->baseVertex;
+	}
+}
+
+#define SKINNING_SOURCE_BINDING 1
+#define SKINNING_OUTPUT_BINDING 2
+#define SKINNING_SKIN_BINDING 3
+#define SKINNING_SOURCE_ATTRIBUTE_BINDING 4
+#define SKINNING_OUTPUT_ATTRIBUTE_BINDING 5
+#define SKINNING_GROUP_SIZE 64
+
+// Skin the source mesh of skinnedMesh with a palette already written to the
+// bone palette buffer. Callers issue a glMemoryBarrier before using the output.
+static void DispatchSkinning(ShaderProgram* skinningProgram, SkinnedMesh* skinnedMesh, int boneOffset, int paletteFormat)
+{
+	Mesh* source = skinnedMesh->source;
+	int vertexCount = skinnedMesh->vertexCount;
+	if (!source->skinBuffer)
+	{
+		// nothing to skin, the bind pose is the result
+		glCopyNamedBufferSubData(source->vertexBuffer, skinnedMesh->vertexBuffer, source->baseVertex * sizeof(glm::vec3), skinnedMesh->baseVertex * sizeof(glm::vec3), vertexCount * sizeof(glm::vec3));
+		glCopyNamedBufferSubData(source->attributeBuffer, skinnedMesh->attributeBuffer, source->baseVertex * ATTRIBUTE_STRIDE, skinnedMesh->baseVertex * ATTRIBUTE_STRIDE, vertexCount * ATTRIBUTE_STRIDE);
+		return;
+	}
+	SetUniform(skinningProgram, "u_boneOffset", boneOffset);
+	SetUniform(skinningProgram, "u_paletteFormat", paletteFormat);
+	SetUniform(skinningProgram, "u_vertexCount", vertexCount);
+	SetUniform(skinningProgram, "u_sourceBaseVertex", source->baseVertex);
+	SetUniform(skinningProgram, "u_outputBaseVertex", skinnedMesh->baseVertex);
+	SetUniform(skinningProgram, "u_skinIndexBits", source->skinIndexBits);
+	SetUniform(skinningProgram, "u_skinWeightBits", source->skinWeightBits);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SKINNING_SOURCE_BINDING, source->vertexBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SKINNING_OUTPUT_BINDING, skinnedMesh->vertexBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SKINNING_SKIN_BINDING, source->skinBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SKINNING_SOURCE_ATTRIBUTE_BINDING, source->attributeBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SKINNING_OUTPUT_ATTRIBUTE_BINDING, skinnedMesh->attributeBuffer);
+	glDispatchCompute((vertexCount + SKINNING_GROUP_SIZE - 1) / SKINNING_GROUP_SIZE, 1, 1);
+}
+
+static void DrawSkinnedMesh(SkinnedMesh* skinnedMesh, GLuint* boundVao, int material = -1)
+{
+	BindVertexArray(skinnedMesh->vao, boundVao);
+	MultiDrawMesh(skinnedMesh->source, &skinnedMesh->draws, material);
+}
+
 static void InitLineRenderer(LineRenderer* lineRenderer, int maxSize) {
 	lineRenderer->maxSize = maxSize;
 	glGenBuffers(1, &lineRenderer->vertexBuffer);
@@ -0,0 +1,138 @@
+#pragma once
+
+// Loaded resources by content. A source is looked up by its canonical path
+// first and only hashed again when the file changed, the resource itself is
+// keyed by that content hash, by the import profile for meshes and by the
+// skeleton they are bound to for clips. Loading
+// a file again, or a copy of it under another path, hands back the slot of
+// the first load and only adds a reference.
+
+#define CACHED_MESH 0
+#define CACHED_TEXTURE 1
+#define CACHED_ANIMATIONS 2
+#define CACHED_KIND_COUNT 3
+
+static const char* cachedKindNames[CACHED_KIND_COUNT] = { "Meshes", "Textures", "Animations" };
+
+// Content hash of a source file as of its last write
+struct CachedSource
+{
+	std::filesystem::file_time_type writeTime;
+	uintmax_t size;
+	unsigned long long hash;
+};
+
+struct CachedResource
+{
+	int kind;
+	// canonical path of the first load
+	std::string path;
+	// slot in the resource array of the kind, clips take count slots from there
+	int index;
+	int count;
+	int references;
+};
+
+struct ResourceCache
+{
+	// by canonical path
+	std::unordered_map<std::string, CachedSource> sources;
+	std::unordered_map<unsigned long long, CachedResource> resources;
+	int hits[CACHED_KIND_COUNT];
+	int misses[CACHED_KIND_COUNT];
+};
+
+static std::string GetCanonicalPath(const std::string& path)
+{
+	std::error_code error;
+	std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+	return error ? path : canonical.generic_string();
+}
+
+// HashFile of path, from the sources while the file is unchanged. A caller
+// that hashed the file already passes knownHash instead.
+static unsigned long long GetSourceHash(ResourceCache* cache, const std::string& path, unsigned long long knownHash = 0)
+{
+	std::string canonicalPath = GetCanonicalPath(path);
+	std::error_code error;
+	std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(canonicalPath, error);
+	if (error) return 0;
+	uintmax_t size = std::filesystem::file_size(canonicalPath, error);
+	if (error) return 0;
+
+	auto source = cache->sources.find(canonicalPath);
+	if (source != cache->sources.end() && source->second.writeTime == writeTime && source->second.size == size)
+	{
+		return source->second.hash;
+	}
+	unsigned long long hash = knownHash ? knownHash : HashFile(canonicalPath);
+	if (hash) cache->sources[canonicalPath] = { writeTime, size, hash };
+	return hash;
+}
+
+static unsigned long long GetResourceKey(int kind, unsigned long long contentKey)
+{
+	return HashBytes(&kind, sizeof(kind), contentKey);
+}
+
+// The cached resource with a new reference, nullptr on a miss
+static CachedResource* FindCached(ResourceCache* cache, int kind, unsigned long long contentKey)
+{
+	auto cached = cache->resources.find(GetResourceKey(kind, contentKey));
+	if (!contentKey || cached == cache->resources.end())
+	{
+		cache->misses[kind]++;
+		return nullptr;
+	}
+	cache->hits[kind]++;
+	cached->second.references++;
+	return &cached->second;
+}
+
+// Record a freshly loaded resource with one reference. Sources that couldn't
+// be hashed stay out, and so does a second slot loaded with the same content.
+static void AddCached(ResourceCache* cache, int kind, unsigned long long contentKey, const std::string& path, int index, int count = 1)
+{
+	if (!contentKey) return;
+	cache->resources.emplace(GetResourceKey(kind, contentKey), CachedResource{ kind, GetCanonicalPath(path), index, count, 1 });
+}
+
+static CachedResource* GetCached(ResourceCache* cache, int kind, int index)
+{
+	for (auto& cached : cache->resources)
+	{
+		if (cached.second.kind == kind && cached.second.index == index) return &cached.second;
+	}
+	return nullptr;
+}
+
+// Drop a reference to the resource in slot index. True when that was the
+// last one or the slot isn't cached, the caller frees the slot then.
+static bool ReleaseCached(ResourceCache* cache, int kind, int index)
+{
+	for (auto cached = cache->resources.begin(); cached != cache->resources.end(); cached++)
+	{
+		if (cached->second.kind != kind || cached->second.index != index) continue;
+		if (--cached->second.references > 0) return false;
+		cache->resources.erase(cached);
+		return true;
+	}
+	return true;
+}
+
+// The slots after index move down once the resource array erases it
+static void RemoveCachedSlot(ResourceCache* cache, int kind, int index)
+{
+	for (auto& cached : cache->resources)
+	{
+		if (cached.second.kind == kind && cached.second.index > index) cached.second.index--;
+	}
+}
+
+// Clips are bound to a skeleton, the same file bound to another one is a
+// different resource
+static unsigned long long GetAnimationKey(unsigned long long sourceHash, Skeleton* skeleton)
+{
+	unsigned long long key = GetAssetKey(sourceHash, animationImportProfile);
+	return key ? HashBytes(&skeleton, sizeof(skeleton), key) : 0;
+}
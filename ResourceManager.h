@@ -38,7 +38,7 @@
 
 struct Skeletons
 {
-	Bone vampireSkeleton;
+	Skeleton vampireSkeleton;
 };
 
 struct Animations
@@ -73,18 +73,105 @@ struct Resource
 	//Animations animations;
 	//Skeletons skeletons;
 	LineRenderer lineRenderer;
+	// shared streams of every mesh, one arena per skin layout
+	MeshArena meshArena;
+	MeshArena skinnedMeshArena;
+	// meshes, textures and clips by content, see Acquire*
+	ResourceCache cache;
+	// off by default, toggled from the scene panel
+	AnimationCompression animationCompression;
+	BonePaletteBuffer bonePalette;
+	ShaderProgram skinningProgram;
 	Window window;
 	SpriteAnimations spriteAnimations;
 	SpriteRenderer sprtieRenderer;
 	//Materials materials;
 };
 
-static void InitResources(Resource* resource, Window* window)
+// Meshes with bone weights go to the arena with a skin stream
+static MeshArena* GetMeshArena(Resource* resource, PackedMesh* mesh)
 {
+	return mesh->skin.empty() ? &resource->meshArena : &resource->skinnedMeshArena;
+}
+
+// Meshes the UI lets pick any material for need what every material's
+// shader reads
+static ImportProfile GetMaterialImportProfile(Resource* resource)
+{
+	std::vector<ShaderProgram*> programs;
+	for (int i = 0; i < resource->materials.size(); i++)
+	{
+		programs.push_back(resource->materials[i].shaderProgram);
+	}
+	return GetImportProfile(programs);
+}
+
+// First slot of the clips in filePath bound to skeleton, loaded and named
+// name on the first request only. A caller that loaded the file already
+// passes it as loaded. count gets the number of clips, -1 when the file
+// fails to load.
+static int AcquireAnimations(Resource* resource, std::string name, std::string filePath, std::shared_ptr<Skeleton> skeleton, int* count, ImportedAsset* loaded = nullptr)
+{
+	unsigned long long key = GetAnimationKey(GetSourceHash(&resource->cache, filePath, loaded ? loaded->sourceHash : 0), skeleton.get());
+	CachedResource* cached = FindCached(&resource->cache, CACHED_ANIMATIONS, key);
+	if (cached)
+	{
+		*count = cached->count;
+		return cached->index;
+	}
+
+	ImportedAsset asset = {};
+	if (!loaded)
+	{
+		if (!LoadAsset(filePath, &asset, animationImportProfile)) return -1;
+		loaded = &asset;
+	}
+	std::vector<Animation>& animations = loaded->animations;
+	BindAnimations(animations, skeleton);
+	int first = resource->animations.size();
+	for (int i = 0; i < animations.size(); i++)
+	{
+		animations[i].name = name;
+		resource->animations.push_back(animations[i]);
+	}
+	*count = animations.size();
+	AddCached(&resource->cache, CACHED_ANIMATIONS, key, filePath, first, *count);
+	CompressAnimations(resource->animations, &resource->animationCompression);
+	return first;
+}
+
+static void InitResources(Resource* resource, Window* window, JobSystem* jobSystem)
+{
+	InitMeshArena(&resource->meshArena, 0);
+	InitMeshArena(&resource->skinnedMeshArena, 8);
+
+	// files load on the workers while the shaders compile, FinishLoading
+	// uploads them into their slots. Meshes are submitted once the shaders
+	// that draw them are linked, their import profile comes from those.
+	AssetLoader loader = {};
+	InitAssetLoader(&loader, jobSystem);
+	resource->meshes.resize(QUAD_MESH + 1);
+	resource->textures.resize(BLACK + 1);
+	ImportedAsset cyberAsset = {};
+	ImportedAsset idleAsset = {};
+	ImportedAsset sphereAsset = {};
+	// set by the uploads, a file that fails to load keeps an empty slot
+	bool cyberLoaded = false;
+	bool sphereLoaded = false;
+	bool idleLoaded = false;
+	// a clip file, bound to the running skeleton below
+	LoadAssetAsync(&loader, "cyber/Neutral Idle.dae", &idleAsset, [&idleLoaded](ImportedAsset* asset) { idleLoaded = true; }, animationImportProfile);
+	const char* texturePaths[] = { "cyber\\textures\\PolygonWestern_Texture_01.png", "white.png", "black.jpg" };
+	unsigned long long textureKeys[BLACK + 1] = {};
+	LoadTextureAsync(&loader, &resource->textures[CYBER_DIFFUSE], "Cyber Diffuse", texturePaths[CYBER_DIFFUSE], &textureKeys[CYBER_DIFFUSE]);
+	LoadTextureAsync(&loader, &resource->textures[WHITE], "White", texturePaths[WHITE], &textureKeys[WHITE]);
+	LoadTextureAsync(&loader, &resource->textures[BLACK], "Black", texturePaths[BLACK], &textureKeys[BLACK]);
+
 	// 0
 	{
 		ShaderProgram colorShader = {};
 		InitShaderProgram(&colorShader, "Phong.vert", "Color.frag");
+		InitInfluenceVariants(&colorShader, "Phong.vert", "Color.frag");
 		resource->shaders.push_back(colorShader);
 		//resource->shaders.color = colorShader;
 	}
@@ -101,6 +188,7 @@ static void InitResources(Resource* resource, Window* window)
 	{
 		ShaderProgram phongShader = {};
 		InitShaderProgram(&phongShader, "Phong.vert", "Phong.frag");
+		InitInfluenceVariants(&phongShader, "Phong.vert", "Phong.frag");
 		resource->shaders.push_back(phongShader);
 		//resource->shaders.phong = phongShader;
 		SetUniform(&resource->shaders[PHONG_SHADER], "u_diffuseTexture", 0);
@@ -121,6 +209,7 @@ static void InitResources(Resource* resource, Window* window)
 	{
 		ShaderProgram normalShader = {};
 		InitShaderProgram(&normalShader, "Phong.vert", "Normal.frag");
+		InitInfluenceVariants(&normalShader, "Phong.vert", "Normal.frag");
 		resource->shaders.push_back(normalShader);
 		//resource->shaders.phong = phongShader;
 		SetUniform(&resource->shaders[NORMAL_SHADER], "u_normalTexture", 0);
@@ -137,6 +226,7 @@ static void InitResources(Resource* resource, Window* window)
 	{
 		ShaderProgram diffuseShader = {};
 		InitShaderProgram(&diffuseShader, "Phong.vert", "Texture.frag");
+		InitInfluenceVariants(&diffuseShader, "Phong.vert", "Texture.frag");
 		resource->shaders.push_back(diffuseShader);
 		//resource->shaders.phong = phongShader;
 		SetUniform(&resource->shaders[TEXTURE_SHADER], "u_texture", 0);
@@ -152,17 +242,114 @@ static void InitResources(Resource* resource, Window* window)
 	{
 		ShaderProgram phongVert = {};
 		InitShaderProgram(&phongVert, "PhongVert.vert", "PhongVert.frag");
+		InitInfluenceVariants(&phongVert, "PhongVert.vert", "PhongVert.frag");
+		resource->shaders.push_back(phongVert);
 		SetUniform(&resource->shaders[PHONG_VERT_SHADER], "u_diffuseTexture", 0);
 		SetUniform(&resource->shaders[PHONG_VERT_SHADER], "u_emissionTexture", 1);
-		resource->shaders.push_back(phongVert);
 	}
 
 	{
 		ShaderProgram vertNormal = {};
 		InitShaderProgram(&vertNormal, "PhongVert.vert", "VertexNormal.frag");
+		InitInfluenceVariants(&vertNormal, "PhongVert.vert", "VertexNormal.frag");
 		resource->shaders.push_back(vertNormal);
 	}
 
+	//{
+	//	Material material = {};
+	//	material.shaderProgram = &resource->shaders[PHONG_SHADER];
+	//	material.type = 0;
+	//	material.name = "Phong";
+	//	material.phong.diffuseTexture = &resource->textures[VAMPIRE_DIFFUSE];
+	//	material.phong.normalTexture = &resource->textures[VAMPIRE_NORMAL];
+	//	material.phong.specularTexture = &resource->textures[VAMPIRE_SPECULAR];
+	//	material.phong.emissionTexture = &resource->textures[VAMPIRE_EMISSION];
+
+	//	material.phong.ka = { 1.0f, 1.0f, 1.0f };
+	//	material.phong.kd = { 1.0f, 1.0f, 1.0f };
+	//	material.phong.ks = { 1.0f, 1.0f, 1.0f };
+	//	material.phong.ke = { 1.0f, 1.0f, 1.0f };
+	//	material.phong.specularPower = 8.0f;
+
+	//	resource->materials.push_back(material);
+	//}
+
+	{
+		Material material = {};
+		material.shaderProgram = &resource->shaders[COLOR_SHADER];
+		material.type = 1;
+		material.name = "Color";
+		material.color.color = { 1.0f, 1.0f, 1.0f };
+
+		resource->materials.push_back(material);
+	}
+
+	/*
+	{
+		Material material = {};
+		material.shaderProgram = &resource->shaders[TEXTURE_SHADER];
+		material.type = 3;
+		material.name = "Diffuse";
+		material.diffuse.texture = &resource->textures[VAMPIRE_DIFFUSE];
+		resource->materials.push_back(material);
+	}
+
+	{
+		Material material = {};
+		material.shaderProgram = &resource->shaders[TEXTURE_SHADER];
+		material.type = 4;
+		material.name = "Specular";
+		material.specular.texture = &resource->textures[VAMPIRE_SPECULAR];
+		resource->materials.push_back(material);
+	}
+
+	{
+		Material material = {};
+		material.shaderProgram = &resource->shaders[TEXTURE_SHADER];
+		material.type = 5;
+		material.name = "Emission";
+		material.diffuse.texture = &resource->textures[VAMPIRE_EMISSION];
+		resource->materials.push_back(material);
+	}*/
+
+	{
+		Material material = {};
+		material.shaderProgram = &resource->shaders[PHONG_VERT_SHADER];
+		material.type = 6;
+		material.name = "Diffuse";
+		material.phongVertexNormal.diffuseTexture = &resource->textures[CYBER_DIFFUSE];
+		material.phongVertexNormal.emissionTexture = &resource->textures[BLACK];
+
+		material.phongVertexNormal.ka = { 1.0f, 1.0f, 1.0f };
+		material.phongVertexNormal.kd = { 1.0f, 1.0f, 1.0f };
+		material.phongVertexNormal.ks = { 1.0f, 1.0f, 1.0f };
+		material.phongVertexNormal.ke = { 0, 0, 0 };
+		material.phongVertexNormal.specularPower = 8.0f;
+		material.phongVertexNormal.specularColor = { 1.0f, 1.0f, 1.0f };
+
+		resource->materials.push_back(material);
+	}
+
+	{
+		Material material = {};
+		material.shaderProgram = &resource->shaders[VERT_NORMAL_SHADER];
+		material.type = 7;
+		material.name = "Vertex Normal";
+
+		resource->materials.push_back(material);
+	}
+
+	// both meshes are in the mesh picker, any material can draw them
+	ImportProfile meshProfile = GetMaterialImportProfile(resource);
+	LoadAssetAsync(&loader, "cyber/Running.dae", &cyberAsset, [resource, &cyberLoaded](ImportedAsset* asset) {
+		UploadMesh("Cyber", &resource->meshes[CYBER_MESH], &asset->mesh, GetMeshArena(resource, &asset->mesh));
+		cyberLoaded = true;
+	}, meshProfile);
+	LoadAssetAsync(&loader, "sphere.obj", &sphereAsset, [resource, &sphereLoaded](ImportedAsset* asset) {
+		UploadMesh("Sphere", &resource->meshes[SPHERE_MESH], &asset->mesh, GetMeshArena(resource, &asset->mesh));
+		sphereLoaded = true;
+	}, meshProfile);
+
 	// msaa
 	{
 		FrameBuffer msaa = {};
@@ -250,59 +437,39 @@ static void InitResources(Resource* resource, Window* window)
 	//	//resource->textures.vampireEmission = vampireEmissionTexture;
 	//}
 
+	FinishLoading(&loader);
+
+	// later loads of the same files reuse these slots
+	for (int i = 0; i <= BLACK; i++)
 	{
-		// init cyber
-		Assimp::Importer importer;
-		const aiScene* scene = importer.ReadFile("cyber/Running.dae", aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+		AddCached(&resource->cache, CACHED_TEXTURE, GetSourceHash(&resource->cache, texturePaths[i], textureKeys[i]), texturePaths[i], i);
+	}
+	if (cyberLoaded) AddCached(&resource->cache, CACHED_MESH, GetAssetKey(GetSourceHash(&resource->cache, "cyber/Running.dae", cyberAsset.sourceHash), meshProfile), "cyber/Running.dae", CYBER_MESH);
+	if (sphereLoaded) AddCached(&resource->cache, CACHED_MESH, GetAssetKey(GetSourceHash(&resource->cache, "sphere.obj", sphereAsset.sourceHash), meshProfile), "sphere.obj", SPHERE_MESH);
 
-		Mesh cyberMesh = {};
+	// shared by every clip that animates the cyber mesh
+	std::shared_ptr<Skeleton> cyberSkeleton = std::make_shared<Skeleton>();
+
+	{
+		// init cyber
 		//Bone vampireSkeleton = {};
 		//int boneCount = 0;
-		MeshData cyberMeshData = LoadMeshData(scene, 0);
 		//LoadBoneData(scene, &vampireMeshData, vampireSkeleton, boneCount);
 		//MeshData vampireMeshData = LoadMeshData(scene, vampireSkeleton, boneCount);
 
-		int k = 0;
-		std::vector<Animation> animations = LoadAnimations(scene, &cyberMeshData);
+		if (cyberAsset.skeleton) cyberSkeleton = cyberAsset.skeleton;
+		int count = 0;
+		if (cyberLoaded) AcquireAnimations(resource, "running", "cyber/Running.dae", cyberSkeleton, &count, &cyberAsset);
 		//resource->skeletons.vampireSkeleton = vampireSkeleton;
-		for (int i = 0; i < animations.size(); i++)
-		{
-			animations[i].name = "running";
-			resource->animations.push_back(animations[i]);
-			resource->animations[resource->animations.size() - 1].currentPose.resize(resource->animations[resource->animations.size() - 1].boneCount, glm::mat4(1.0f));
-		}
 		//resource->animations.vampireAnimation = animations[0];
-		InitMesh("Cyber", &cyberMesh, &cyberMeshData);
-		resource->meshes.push_back(cyberMesh);
 
 		//resource->animations.vampireAnimation.currentPose.resize(boneCount, glm::mat4(1.0f));
-
-		Texture cyberDiffuseTexture = {};
-		LoadTexture(&cyberDiffuseTexture, "Cyber Diffuse", "cyber\\textures\\PolygonWestern_Texture_01.png");
-		resource->textures.push_back(cyberDiffuseTexture);
 	}
 
 	{
-		// init cyber
-		Assimp::Importer importer;
-		const aiScene* scene = importer.ReadFile("cyber/Neutral Idle.dae", aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-
-		Mesh cyberMesh = {};
-		//Bone vampireSkeleton = {};
-		//int boneCount = 0;
-		MeshData cyberMeshData = LoadMeshData(scene, 0);
-		//LoadBoneData(scene, &vampireMeshData, vampireSkeleton, boneCount);
-		//MeshData vampireMeshData = LoadMeshData(scene, vampireSkeleton, boneCount);
-
-		int k = 0;
-		std::vector<Animation> animations = LoadAnimations(scene, &cyberMeshData);
-		//resource->skeletons.vampireSkeleton = vampireSkeleton;
-		for (int i = 0; i < animations.size(); i++)
-		{
-			animations[i].name = "idle";
-			resource->animations.push_back(animations[i]);
-			resource->animations[resource->animations.size() - 1].currentPose.resize(resource->animations[resource->animations.size() - 1].boneCount, glm::mat4(1.0f));
-		}
+		// the idle clip drives the running mesh, so bind it to the same skeleton
+		int count = 0;
+		if (idleLoaded) AcquireAnimations(resource, "idle", "cyber/Neutral Idle.dae", cyberSkeleton, &count, &idleAsset);
 		//resource->animations.vampireAnimation = animations[0];
 		//InitMesh("Cyber", &cyberMesh, &cyberMeshData);
 		//resource->meshes.push_back(cyberMesh);
@@ -310,112 +477,9 @@ static void InitResources(Resource* resource, Window* window)
 		//resource->animations.vampireAnimation.currentPose.resize(boneCount, glm::mat4(1.0f));
 	}
 
-	{
-		Texture whiteTexture = {};
-		LoadTexture(&whiteTexture, "White", "white.png");
-		resource->textures.push_back(whiteTexture);
-	}
-
-	{
-		Texture blackTexture = {};
-		LoadTexture(&blackTexture, "Black", "black.jpg");
-		resource->textures.push_back(blackTexture);
-	}
-
-
-
-	//{
-	//	Material material = {};
-	//	material.shaderProgram = &resource->shaders[PHONG_SHADER];
-	//	material.type = 0;
-	//	material.name = "Phong";
-	//	material.phong.diffuseTexture = &resource->textures[VAMPIRE_DIFFUSE];
-	//	material.phong.normalTexture = &resource->textures[VAMPIRE_NORMAL];
-	//	material.phong.specularTexture = &resource->textures[VAMPIRE_SPECULAR];
-	//	material.phong.emissionTexture = &resource->textures[VAMPIRE_EMISSION];
-
-	//	material.phong.ka = { 1.0f, 1.0f, 1.0f };
-	//	material.phong.kd = { 1.0f, 1.0f, 1.0f };
-	//	material.phong.ks = { 1.0f, 1.0f, 1.0f };
-	//	material.phong.ke = { 1.0f, 1.0f, 1.0f };
-	//	material.phong.specularPower = 8.0f;
-
-	//	resource->materials.push_back(material);
-	//}
-
-	{
-		Material material = {};
-		material.shaderProgram = &resource->shaders[COLOR_SHADER];
-		material.type = 1;
-		material.name = "Color";
-		material.color.color = { 1.0f, 1.0f, 1.0f };
-
-		resource->materials.push_back(material);
-	}
-
-	/*
-	{
-		Material material = {};
-		material.shaderProgram = &resource->shaders[TEXTURE_SHADER];
-		material.type = 3;
-		material.name = "Diffuse";
-		material.diffuse.texture = &resource->textures[VAMPIRE_DIFFUSE];
-		resource->materials.push_back(material);
-	}
-
-	{
-		Material material = {};
-		material.shaderProgram = &resource->shaders[TEXTURE_SHADER];
-		material.type = 4;
-		material.name = "Specular";
-		material.specular.texture = &resource->textures[VAMPIRE_SPECULAR];
-		resource->materials.push_back(material);
-	}
-
-	{
-		Material material = {};
-		material.shaderProgram = &resource->shaders[TEXTURE_SHADER];
-		material.type = 5;
-		material.name = "Emission";
-		material.diffuse.texture = &resource->textures[VAMPIRE_EMISSION];
-		resource->materials.push_back(material);
-	}*/
-
-	{
-		Material material = {};
-		material.shaderProgram = &resource->shaders[PHONG_VERT_SHADER];
-		material.type = 6;
-		material.name = "Diffuse";
-		material.phongVertexNormal.diffuseTexture = &resource->textures[CYBER_DIFFUSE];
-		material.phongVertexNormal.emissionTexture = &resource->textures[BLACK];
-
-		material.phongVertexNormal.ka = { 1.0f, 1.0f, 1.0f };
-		material.phongVertexNormal.kd = { 1.0f, 1.0f, 1.0f };
-		material.phongVertexNormal.ks = { 1.0f, 1.0f, 1.0f };
-		material.phongVertexNormal.ke = { 0, 0, 0 };
-		material.phongVertexNormal.specularPower = 8.0f;
-		material.phongVertexNormal.specularColor = { 1.0f, 1.0f, 1.0f };
-
-		resource->materials.push_back(material);
-	}
-
-	{
-		Material material = {};
-		material.shaderProgram = &resource->shaders[VERT_NORMAL_SHADER];
-		material.type = 7;
-		material.name = "Vertex Normal";
-
-		resource->materials.push_back(material);
-	}
-
-	{
-		Assimp::Importer importer;
-		const aiScene* scene = importer.ReadFile("sphere.obj", aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-		Mesh sphereMesh = {};
-		MeshData sphereMeshData = LoadMeshData(scene, 0);
-		InitMesh("Sphere", &sphereMesh, &sphereMeshData);
-		resource->meshes.push_back(sphereMesh);
-	}
+	resource->bonePalette.format = PALETTE_AFFINE;
+	InitBonePaletteBuffer(&resource->bonePalette, 16384);
+	InitComputeProgram(&resource->skinningProgram, "Skinning.comp");
 
 	// quad mesh
 	{
@@ -443,9 +507,7 @@ static void InitResources(Resource* resource, Window* window)
 		quadMeshData.vertices[3] = v3;
 		quadMeshData.indices = { 0, 1, 2, 1, 3, 2 };
 
-		Mesh quadMesh = {};
-		InitMesh("Quad", &quadMesh, &quadMeshData);
-		resource->meshes.push_back(quadMesh);
+		InitMesh("Quad", &resource->meshes[QUAD_MESH], &quadMeshData, &resource->meshArena);
 	}
 
 
@@ -501,11 +563,28 @@ static void OnWindowResize(GLFWwindow* window, int width, int height)
 	windowData->shouldUpdate = true;
 }
 
-static void RemoveTexture(Resource* resource, int index)
+// Drops one reference, the mesh is destroyed with the last one. True when
+// the slot was erased.
+static bool RemoveMesh(Resource* resource, int index)
 {
-	if (index >= resource->textures.size()) return;
+	if (index >= resource->meshes.size()) return false;
+	if (!ReleaseCached(&resource->cache, CACHED_MESH, index)) return false;
+	DestroyMesh(&resource->meshes[index]);
+	resource->meshes.erase(resource->meshes.begin() + index);
+	RemoveCachedSlot(&resource->cache, CACHED_MESH, index);
+	return true;
+}
+
+// Drops one reference, the texture is deleted with the last one. True when
+// the slot was erased.
+static bool RemoveTexture(Resource* resource, int index)
+{
+	if (index >= resource->textures.size()) return false;
+	if (!ReleaseCached(&resource->cache, CACHED_TEXTURE, index)) return false;
 	glDeleteTextures(1, &resource->textures[index].id);
 	resource->textures.erase(resource->textures.begin() + index);
+	RemoveCachedSlot(&resource->cache, CACHED_TEXTURE, index);
+	return true;
 }
 
 static void DestroyResources(Resource* resource, Window* window)
@@ -515,6 +594,11 @@ static void DestroyResources(Resource* resource, Window* window)
 		glDeleteTextures(1, &resource->textures[i].id);
 	}
 
+	for (int i = 0; i < resource->animations.size(); i++)
+	{
+		glDeleteTextures(1, &resource->animations[i].bakedPalette.id);
+	}
+
 	for (int i = 0; i < resource->spriteAnimations.count; i++)
 	{
 		for (int j = 0; j < resource->spriteAnimations.textures[i].size(); j++)
@@ -532,34 +616,47 @@ static void DestroyResources(Resource* resource, Window* window)
 
 	for (int i = 0; i < resource->meshes.size(); i++)
 	{
-		glDeleteVertexArrays(1, &resource->meshes[i].vao);
-		glDeleteBuffers(1, &resource->meshes[i].vertexBuffer);
-		glDeleteBuffers(1, &resource->meshes[i].indexBuffer);
+		DestroyMesh(&resource->meshes[i]);
 	}
+	DestroyMeshArena(&resource->meshArena);
+	DestroyMeshArena(&resource->skinnedMeshArena);
+	resource->cache = {};
+
+	DestroyBonePaletteBuffer(&resource->bonePalette);
+	glDeleteProgram(resource->skinningProgram.shaderProgram);
 
 	glDeleteVertexArrays(1, &resource->lineRenderer.vao);
 	glDeleteVertexArrays(1, &resource->lineRenderer.vertexBuffer);
 }
 
-static bool LoadMeshData(std::string filePath, MeshData* meshData)
+// Slot of the mesh in filePath imported with profile, loaded on the first
+// request only. -1 when the file fails to load.
+static int AcquireMesh(Resource* resource, std::string name, std::string filePath, ImportProfile profile)
 {
-	Assimp::Importer importer;
-	const aiScene* scene = importer.ReadFile(filePath, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-	if (!scene) return false;
-
-	*meshData = LoadMeshData(scene, 0);
-
-	return true;
+	unsigned long long key = GetAssetKey(GetSourceHash(&resource->cache, filePath), profile);
+	CachedResource* cached = FindCached(&resource->cache, CACHED_MESH, key);
+	if (cached) return cached->index;
+
+	ImportedAsset asset = {};
+	if (!LoadAsset(filePath, &asset, profile)) return -1;
+	Mesh mesh = {};
+	UploadMesh(name, &mesh, &asset.mesh, GetMeshArena(resource, &asset.mesh));
+	resource->meshes.push_back(mesh);
+	AddCached(&resource->cache, CACHED_MESH, key, filePath, resource->meshes.size() - 1);
+	return resource->meshes.size() - 1;
 }
 
-static bool LoadAnimations(std::string filePath, std::vector<Animation>& animations, MeshData* meshData)
+static int AcquireTexture(Resource* resource, std::string name, std::string filePath)
 {
-	Assimp::Importer importer;
-	const aiScene* scene = importer.ReadFile(filePath, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-	if (!scene) return false;
-	
-	animations = LoadAnimations(scene, meshData);
-	return true;
+	unsigned long long key = GetSourceHash(&resource->cache, filePath);
+	CachedResource* cached = FindCached(&resource->cache, CACHED_TEXTURE, key);
+	if (cached) return cached->index;
+
+	Texture texture = {};
+	if (!LoadTexture(&texture, name, filePath)) return -1;
+	resource->textures.push_back(texture);
+	AddCached(&resource->cache, CACHED_TEXTURE, key, filePath, resource->textures.size() - 1);
+	return resource->textures.size() - 1;
 }
 
 //static bool LoadAnimationData(std::string filePath, Skeleton* skeleton)
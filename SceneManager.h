@@ -17,7 +17,15 @@ struct Models
 	std::vector<glm::vec3> scales;
 	//std::vector<glm::mat4> transforms;
 	std::vector<Material*> materials;
+	// per material slot of the mesh, slots without one draw with materials
+	std::vector<std::vector<Material*>> slotMaterials;
 	std::vector<Animation*> animations;
+	std::vector<int> animationInstances;
+	// sample the pose from the baked palette on the GPU instead of the CPU
+	std::vector<bool> baked;
+	// output of the compute skinning pass, drawn instead of the mesh when preSkinned
+	std::vector<SkinnedMesh> skinnedMeshes;
+	std::vector<bool> preSkinned;
 	int count;
 };
 
@@ -27,11 +35,31 @@ struct AmbientLight
 	float intensity;
 };
 
+#define ANIMATION_LOD_FULL 0
+#define ANIMATION_LOD_HALF 1
+#define ANIMATION_LOD_QUARTER 2
+
+// Animation level of detail from the projected size of each model. Half and
+// quarter levels update every second or fourth frame and reuse the last pose
+// in between, the quarter level also skips the skeleton's detail bones.
+struct AnimationLOD
+{
+	bool enabled;
+	// bounding sphere diameter over screen height needed for each level
+	float fullRateCoverage;
+	float halfRateCoverage;
+	int frame;
+	// models at each level in the last update
+	int counts[3];
+};
+
 struct Scene
 {
 	PointLights pointLights;
 	Camera camera;
 	Models models;
+	AnimationInstancePool animationInstances;
+	AnimationLOD animationLOD;
 	AmbientLight ambientLight;
 	Camera2D camera2D;
 };
@@ -44,8 +72,49 @@ static void AddPointLight(Scene* scene, glm::vec3 lightPosition, glm::vec3 light
 	scene->pointLights.count++;
 }
 
-static std::pair<glm::vec3, glm::vec3> GetAnimationBoundingVolume(Mesh* mesh, Animation* animation, glm::mat4 modelMatrix, int frames)
+// Skin every frame with the compute pass and read the positions back
+static std::pair<glm::vec3, glm::vec3> GetSkinnedBoundingVolume(Mesh* mesh, Animation* animation, glm::mat4 modelMatrix, int frames, ShaderProgram* skinningProgram, BonePaletteBuffer* bonePalette)
 {
+	float frameTime = 0;
+	float timeIncrement = animation->duration / frames;
+	glm::vec3 boundsMin = glm::vec3(FLT_MAX);
+	glm::vec3 boundsMax = glm::vec3(-FLT_MAX);
+
+	AnimationInstance instance = {};
+	BindAnimationInstance(&instance, animation);
+	SkinnedMesh skinnedMesh = {};
+	InitSkinnedMesh(&skinnedMesh, mesh);
+	std::vector<glm::vec3> positions(mesh->vertexCount);
+
+	for (int i = 0; i < frames; i++)
+	{
+		GetPose(&instance, frameTime);
+		BeginBonePaletteFrame(bonePalette, instance.pose.size() * GetPaletteStride(bonePalette->format));
+		int boneOffset = AllocateBonePalette(bonePalette, instance.pose.data(), instance.pose.size());
+		DispatchSkinning(skinningProgram, &skinnedMesh, boneOffset, bonePalette->format);
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		glGetNamedBufferSubData(skinnedMesh.vertexBuffer, skinnedMesh.baseVertex * sizeof(glm::vec3), positions.size() * sizeof(glm::vec3), positions.data());
+
+		for (int j = 0; j < positions.size(); j++)
+		{
+			glm::vec3 position = modelMatrix * glm::vec4(positions[j], 1.0f);
+			boundsMin = glm::min(boundsMin, position);
+			boundsMax = glm::max(boundsMax, position);
+		}
+		frameTime += timeIncrement;
+	}
+
+	DestroySkinnedMesh(&skinnedMesh);
+	return { boundsMin, boundsMax };
+}
+
+static std::pair<glm::vec3, glm::vec3> GetAnimationBoundingVolume(Mesh* mesh, Animation* animation, glm::mat4 modelMatrix, int frames, ShaderProgram* skinningProgram = nullptr, BonePaletteBuffer* bonePalette = nullptr)
+{
+	if (skinningProgram)
+	{
+		return GetSkinnedBoundingVolume(mesh, animation, modelMatrix, frames, skinningProgram, bonePalette);
+	}
+
 	float frameTime = 0;
 	float timeIncrement = animation->duration / frames;
 
@@ -58,26 +127,30 @@ static std::pair<glm::vec3, glm::vec3> GetAnimationBoundingVolume(Mesh* mesh, An
 	float minZ = FLT_MAX;
 	float maxZ = FLT_MIN;
 
+	AnimationInstance instance = {};
+	BindAnimationInstance(&instance, animation);
+
 	for (int i = 0; i < frames; i++)
 	{
-		glm::mat4 parentTransform(1.0f);
-		GetPose(animation, animation->skeleton, frameTime, parentTransform);
-		std::vector<glm::mat4> boneTransforms = animation->currentPose;
-		for (int j = 0; j < mesh->vertices.size(); j++)
+		GetPose(&instance, frameTime);
+		std::vector<glm::mat4>& boneTransforms = instance.pose;
+		for (int j = 0; j < mesh->vertexCount; j++)
 		{
-			VertexData vertex = mesh->vertices[j];
+			int boneIds[MAX_BONE_INFLUENCE] = {};
+			float weights[MAX_BONE_INFLUENCE] = {};
+			if (!mesh->skin.empty()) UnpackSkin(mesh->skin.data(), mesh->skinIndexBits, mesh->skinWeightBits, j, boneIds, weights);
 			glm::mat4 boneTransform = glm::mat4(0.0f);
-			for (int k = 0; k < 4; k++)
+			for (int k = 0; k < MAX_BONE_INFLUENCE && weights[k] > 0.0f; k++)
 			{
-				boneTransform += boneTransforms[vertex.animated.boneIDs[k]] * vertex.animated.weights[k];
+				boneTransform += boneTransforms[boneIds[k]] * weights[k];
 			}
 
-			if (vertex.animated.weights[0] == 0)
+			if (weights[0] == 0)
 			{
 				boneTransform = glm::mat4(1.0f);
 			}
 
-			glm::vec4 pos = boneTransform * glm::vec4(vertex.mesh.position, 1.0f);
+			glm::vec4 pos = boneTransform * glm::vec4(mesh->positions[j], 1.0f);
 			glm::vec4 finalPos = modelMatrix * pos;
 			if (finalPos.x > maxX) maxX = finalPos.x;
 			if (finalPos.x < minX) minX = finalPos.x;
@@ -101,10 +174,9 @@ static std::pair<glm::vec3, glm::vec3> GetBoundingVolume(Mesh* mesh, glm::mat4 m
 
 	float minZ = FLT_MAX;
 	float maxZ = FLT_MIN;
-	for (int i = 0; i < mesh->vertices.size(); i++)
+	for (int i = 0; i < mesh->vertexCount; i++)
 	{
-		VertexData vertex = mesh->vertices[i];
-		glm::vec4 pos = glm::vec4(vertex.mesh.position, 1.0f);
+		glm::vec4 pos = glm::vec4(mesh->positions[i], 1.0f);
 		glm::vec4 finalPos = modelMatrix * pos;
 		if (finalPos.x > maxX) maxX = finalPos.x;
 		if (finalPos.x < minX) minX = finalPos.x;
@@ -136,7 +208,12 @@ static void AddModel(
 	scene->models.scales.push_back(scale);
 
 	scene->models.materials.push_back(material);
+	scene->models.slotMaterials.push_back({});
 	scene->models.animations.push_back(animation);
+	scene->models.animationInstances.push_back(CreateAnimationInstance(&scene->animationInstances, animation));
+	scene->models.baked.push_back(false);
+	scene->models.skinnedMeshes.push_back({});
+	scene->models.preSkinned.push_back(false);
 	scene->models.count++;
 
 }
@@ -236,25 +313,205 @@ static void UpdateMaterial(Material* material)
 	}
 }
 
-static void UpdateModels(Models& models, float elapsedTime)
+static bool SphereInFrustum(const glm::mat4& viewProjection, glm::vec3 center, float radius)
 {
+	// planes are the sums and differences of the last row with the other three
+	for (int row = 0; row < 3; row++)
+	{
+		for (int side = -1; side <= 1; side += 2)
+		{
+			glm::vec4 plane;
+			for (int c = 0; c < 4; c++)
+			{
+				plane[c] = viewProjection[c][3] + side * viewProjection[c][row];
+			}
+			float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+			if (distance < -radius * glm::length(glm::vec3(plane))) return false;
+		}
+	}
+	return true;
+}
+
+static int GetAnimationLOD(AnimationLOD* lod, Camera* camera, const glm::mat4& viewProjection, Mesh* mesh, glm::mat4 modelMatrix)
+{
+	glm::vec3 center = modelMatrix * glm::vec4(mesh->boundsCenter, 1.0f);
+	float scale = std::max(glm::length(glm::vec3(modelMatrix[0])), std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+	float radius = mesh->boundsRadius * scale;
+	if (!SphereInFrustum(viewProjection, center, radius)) return ANIMATION_LOD_QUARTER;
+
+	float distance = glm::length(center - camera->position);
+	if (distance <= radius) return ANIMATION_LOD_FULL;
+	float coverage = radius / (distance * std::tan(camera->fovY * 0.5f));
+	if (coverage >= lod->fullRateCoverage) return ANIMATION_LOD_FULL;
+	if (coverage >= lod->halfRateCoverage) return ANIMATION_LOD_HALF;
+	return ANIMATION_LOD_QUARTER;
+}
+
+static Material* GetSlotMaterial(Models& models, int model, int slot)
+{
+	std::vector<Material*>& slots = models.slotMaterials[model];
+	return slot < slots.size() && slots[slot] ? slots[slot] : models.materials[model];
+}
+
+// Shaders drawing any material slot of the model, each once
+static std::vector<ShaderProgram*> GetModelShaders(Models& models, int model)
+{
+	std::vector<ShaderProgram*> shaders;
+	for (int slot = 0; slot < models.meshes[model]->materialCount; slot++)
+	{
+		ShaderProgram* shader = GetSlotMaterial(models, model, slot)->shaderProgram;
+		if (std::find(shaders.begin(), shaders.end(), shader) == shaders.end()) shaders.push_back(shader);
+	}
+	return shaders;
+}
+
+// CPU only, evaluates the pose of every animated model. Instances sharing a
+// clip are split into batches which run in parallel on the job system.
+// Without a lod every model is evaluated at full detail, captures rely on that.
+static void EvaluateModelPoses(Models& models, AnimationInstancePool& animationInstances, float elapsedTime, JobSystem* jobSystem, Camera* camera = nullptr, AnimationLOD* lod = nullptr)
+{
+	glm::mat4 viewProjection = glm::mat4(1.0f);
+	if (lod)
+	{
+		viewProjection = GetProjectionMatrix(camera) * GetViewMatrix(camera);
+		lod->frame++;
+		lod->counts[ANIMATION_LOD_FULL] = 0;
+		lod->counts[ANIMATION_LOD_HALF] = 0;
+		lod->counts[ANIMATION_LOD_QUARTER] = 0;
+	}
+
+	// instances due this frame, flagged when they skip their detail bones
+	std::vector<std::pair<AnimationInstance*, bool>> due;
+	for (int i = 0; i < models.count; i++)
+	{
+		if (!models.animations[i] || models.baked[i]) continue;
+		int handle = models.animationInstances[i];
+		AnimationInstance* instance = &animationInstances.instances[handle];
+		bool rebound = instance->animation != models.animations[i];
+		if (rebound)
+		{
+			BindAnimationInstance(instance, models.animations[i]);
+		}
+
+		int level = ANIMATION_LOD_FULL;
+		if (lod && lod->enabled)
+		{
+			glm::mat4 modelMatrix = GetModelMatrix(models.positions[i], models.rotations[i], models.scales[i]);
+			level = GetAnimationLOD(lod, camera, viewProjection, models.meshes[i], modelMatrix);
+			lod->counts[level]++;
+		}
+
+		// stagger the reduced rates by handle so the work spreads across frames
+		int interval = 1 << level;
+		if (level != ANIMATION_LOD_FULL && !rebound && (lod->frame + handle) % interval != 0) continue;
+		due.push_back({ instance, level == ANIMATION_LOD_QUARTER });
+	}
+	std::sort(due.begin(), due.end(), [](const std::pair<AnimationInstance*, bool>& a, const std::pair<AnimationInstance*, bool>& b) {
+		if (a.first->animation != b.first->animation) return a.first->animation < b.first->animation;
+		return a.second < b.second;
+	});
+
+	std::vector<AnimationInstance*> instances(due.size());
+	std::vector<std::pair<int, int>> batches;
+	for (int first = 0; first < due.size();)
+	{
+		int last = first;
+		while (last < due.size() && last - first < POSE_BATCH_MAX_INSTANCES && due[last].first->animation == due[first].first->animation && due[last].second == due[first].second)
+		{
+			instances[last] = due[last].first;
+			last++;
+		}
+		batches.push_back({ first, last - first });
+		first = last;
+	}
+
+	std::vector<float> times(instances.size());
+	for (int i = 0; i < instances.size(); i++)
+	{
+		times[i] = GetClipTime(instances[i]->animation, elapsedTime);
+	}
+	ParallelFor(jobSystem, batches.size(), 1, [&](int begin, int end) {
+		for (int i = begin; i < end; i++)
+		{
+			int first = batches[i].first;
+			EvaluatePoseBatch(&instances[first], &times[first], batches[i].second, due[first].second);
+		}
+	});
+}
+
+// GL only, uploads the model uniforms and the poses from EvaluateModelPoses.
+// All palettes of the frame are written into one buffer, each draw only sets its offset.
+// With a skinning program animated models are skinned once by a compute pass
+// and every later pass draws the result as a static mesh.
+static void UpdateModels(Models& models, AnimationInstancePool& animationInstances, float elapsedTime, BonePaletteBuffer* bonePalette, ShaderProgram* skinningProgram = nullptr)
+{
+	bool dispatched = false;
+	int entryCount = 0;
+	for (int i = 0; i < models.count; i++)
+	{
+		if (!models.animations[i] || models.baked[i]) continue;
+		entryCount += animationInstances.instances[models.animationInstances[i]].pose.size() * GetPaletteStride(bonePalette->format);
+	}
+	BeginBonePaletteFrame(bonePalette, entryCount);
+
 	for (int i = 0; i < models.count; i++)
 	{
-		ShaderProgram* shader = models.materials[i]->shaderProgram;
-		UpdateMaterial(models.materials[i]);
 		glm::mat4 modelMatrix = GetModelMatrix(models.positions[i], models.rotations[i], models.scales[i]);
-		SetUniform(shader, "u_modelMatrix", modelMatrix);
-		if (models.animations[i])
+		Animation* animation = models.animations[i];
+		bool baked = animation && models.baked[i];
+		models.preSkinned[i] = false;
+		float bakedTime = 0.0f;
+		int boneOffset = 0;
+		if (baked)
 		{
-			glm::mat4 parentTransform(1.0f);
-			GetPose(models.animations[i], models.animations[i]->skeleton, elapsedTime, parentTransform);
-			SetUniform(shader, "u_boneTransforms", models.animations[i]->currentPose[0], models.animations[i]->currentPose.size());
-			SetUniform(shader, "u_animated", true);
+			if (!animation->bakedPalette.id)
+			{
+				BakeAnimation(animation);
+			}
+			BindTexture(&animation->bakedPalette, BAKED_PALETTE_TEXTURE_UNIT);
+			bakedTime = fmod(GetClipTime(animation, elapsedTime), animation->duration) / animation->duration;
 		}
-		else {
-			SetUniform(shader, "u_animated", false);
+		else if (animation)
+		{
+			AnimationInstance* instance = &animationInstances.instances[models.animationInstances[i]];
+			boneOffset = AllocateBonePalette(bonePalette, instance->pose.data(), instance->pose.size());
+			models.preSkinned[i] = skinningProgram != nullptr;
+			if (models.preSkinned[i])
+			{
+				if (models.skinnedMeshes[i].source != models.meshes[i])
+				{
+					InitSkinnedMesh(&models.skinnedMeshes[i], models.meshes[i]);
+				}
+				DispatchSkinning(skinningProgram, &models.skinnedMeshes[i], boneOffset, bonePalette->format);
+				dispatched = true;
+			}
+		}
+
+		// every material slot may draw with another shader
+		for (ShaderProgram* shader : GetModelShaders(models, i))
+		{
+			SetUniform(shader, "u_modelMatrix", modelMatrix);
+			SetUniform(shader, "u_animated", animation != nullptr && !models.preSkinned[i]);
+			if (baked)
+			{
+				SetUniform(shader, "u_bakedPalette", BAKED_PALETTE_TEXTURE_UNIT);
+				SetUniform(shader, "u_bakedTime", bakedTime);
+				SetUniform(shader, "u_baked", true);
+			}
+			else if (animation && !models.preSkinned[i])
+			{
+				SetUniform(shader, "u_boneOffset", boneOffset);
+				SetUniform(shader, "u_paletteFormat", bonePalette->format);
+				SetUniform(shader, "u_baked", false);
+			}
 		}
 	}
+
+	// skinned vertices are read as attributes by every pass that follows
+	if (dispatched)
+	{
+		glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+	}
 }
 
 static void UpdateAmbientLight(ShaderProgram* shaderProgram, AmbientLight& ambientLight)
@@ -273,11 +530,32 @@ static void UpdateScene(ShaderProgram* shaderProgram, Scene& scene, float elapse
 
 static void RenderModels(Models& models)
 {
+	// models of one mesh arena only switch vertex arrays with the vertex format
+	GLuint boundVao = 0;
 	for (int i = 0; i < models.count; i++)
 	{
-		glUseProgram(models.materials[i]->shaderProgram->shaderProgram);
-		DrawMesh(models.meshes[i]);
+		// one run of draws per material slot, a single slot draws everything at once
+		int materialCount = models.meshes[i]->materialCount;
+		for (int slot = 0; slot < materialCount; slot++)
+		{
+			Material* material = GetSlotMaterial(models, i, slot);
+			int run = materialCount > 1 ? slot : -1;
+			UpdateMaterial(material);
+			glUseProgram(material->shaderProgram->shaderProgram);
+			if (models.preSkinned[i])
+			{
+				DrawSkinnedMesh(&models.skinnedMeshes[i], &boundVao, run);
+			}
+			else if (models.animations[i])
+			{
+				DrawInfluenceBuckets(models.meshes[i], material->shaderProgram, &boundVao, run);
+			}
+			else {
+				DrawMesh(models.meshes[i], material->shaderProgram, &boundVao, run);
+			}
+		}
 	}
+	glBindVertexArray(0);
 }
 
 static void RenderLigths(ShaderProgram* shaderProgram, Resource& resourceManager, Scene& scene)
@@ -303,6 +581,28 @@ static void RenderLigths(ShaderProgram* shaderProgram, Resource& resourceManager
 	}
 }
 
+// RemoveMesh for a mesh no model draws. Models point into the mesh array, so
+// the ones drawing a later slot move down with it. True when the slot was erased.
+static bool RemoveSceneMesh(Scene* scene, Resource* resource, int index)
+{
+	Models& models = scene->models;
+	std::vector<int> meshIndices(models.count);
+	for (int i = 0; i < models.count; i++)
+	{
+		meshIndices[i] = models.meshes[i] - resource->meshes.data();
+		if (meshIndices[i] == index) return false;
+	}
+	if (!RemoveMesh(resource, index)) return false;
+
+	for (int i = 0; i < models.count; i++)
+	{
+		if (meshIndices[i] > index) meshIndices[i]--;
+		models.meshes[i] = &resource->meshes[meshIndices[i]];
+		if (models.skinnedMeshes[i].source) models.skinnedMeshes[i].source = models.meshes[i];
+	}
+	return true;
+}
+
 static void InitScene(Scene* scene, Resource* resource, Window* window)
 {
 	{
@@ -319,6 +619,15 @@ static void InitScene(Scene* scene, Resource* resource, Window* window)
 		scene->camera = camera;
 	}
 
+	{
+		// changes what the viewer shows, so it is off until turned on in the scene panel
+		AnimationLOD animationLOD = {};
+		animationLOD.enabled = false;
+		animationLOD.fullRateCoverage = 0.25f;
+		animationLOD.halfRateCoverage = 0.08f;
+		scene->animationLOD = animationLOD;
+	}
+
 	{
 		Camera2D camera2D = {};
 		camera2D.position = { 0, 0 };
@@ -1,13 +1,16 @@
 #version 450
 
 layout (location = 0) in vec3 a_position;
-layout (location = 1) in vec3 a_normal;
-layout (location = 2) in vec3 a_tangent;
-layout (location = 3) in vec3 a_bitangent;
+// octahedral normal, octahedral tangent with the bitangent sign in z
+layout (location = 1) in vec2 a_normal;
+layout (location = 2) in vec4 a_tangent;
 layout (location = 4) in vec3 a_color;
 layout (location = 5) in vec2 a_uvs;
-layout (location = 6) in ivec4 a_boneIds;
+// packed skin stream, unsigned ids and normalized weights
+layout (location = 6) in uvec4 a_boneIds;
 layout (location = 7) in vec4 a_weights;
+layout (location = 8) in uvec4 a_boneIdsHigh;
+layout (location = 9) in vec4 a_weightsHigh;
 
 out vec3 v_color;
 out vec2 v_uvs;
@@ -19,23 +22,132 @@ uniform mat4 u_projectionMatrix;
 uniform mat4 u_viewMatrix;
 uniform mat4 u_modelMatrix;
 
-const int MAX_BONES = 100;
-const int MAX_BONE_INFLUENCE = 4;
-uniform mat4 u_boneTransforms[MAX_BONES];
+// InitInfluenceVariants compiles this with fewer influences, the weights are
+// sorted so a variant only reads the ones its vertices use
+#ifndef MAX_BONE_INFLUENCE
+#define MAX_BONE_INFLUENCE 8
+#endif
+
+vec3 OctDecode(vec2 p)
+{
+	vec3 v = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+	float t = max(-v.z, 0.0);
+	v.xy += vec2(v.x >= 0.0 ? -t : t, v.y >= 0.0 ? -t : t);
+	return normalize(v);
+}
+
+int GetBoneId(int i)
+{
+	return int(i < 4 ? a_boneIds[i] : a_boneIdsHigh[i - 4]);
+}
+
+float GetWeight(int i)
+{
+	return i < 4 ? a_weights[i] : a_weightsHigh[i - 4];
+}
+
+// palettes of every instance this frame, u_boneOffset is where this draw's starts
+layout (std430, binding = 0) readonly buffer BonePalette
+{
+	vec4 b_bonePalette[];
+};
+uniform int u_boneOffset;
+
+// matches PALETTE_* in Renderer.h
+const int PALETTE_MAT4 = 0;
+const int PALETTE_AFFINE = 1;
+const int PALETTE_DUAL_QUATERNION = 2;
+uniform int u_paletteFormat;
 uniform bool u_animated;
 
+// baked palette, rows are frames and each bone takes three texels
+uniform bool u_baked;
+uniform sampler2D u_bakedPalette;
+// clip time normalised to [0, 1)
+uniform float u_bakedTime;
+
+mat4 FetchBakedBone(int bone, int frame)
+{
+	vec4 row0 = texelFetch(u_bakedPalette, ivec2(bone * 3 + 0, frame), 0);
+	vec4 row1 = texelFetch(u_bakedPalette, ivec2(bone * 3 + 1, frame), 0);
+	vec4 row2 = texelFetch(u_bakedPalette, ivec2(bone * 3 + 2, frame), 0);
+	return transpose(mat4(row0, row1, row2, vec4(0.0, 0.0, 0.0, 1.0)));
+}
+
+mat4 GetPaletteBone(int bone)
+{
+	if (u_paletteFormat == PALETTE_AFFINE)
+	{
+		int entry = u_boneOffset + bone * 3;
+		return transpose(mat4(b_bonePalette[entry], b_bonePalette[entry + 1], b_bonePalette[entry + 2], vec4(0.0, 0.0, 0.0, 1.0)));
+	}
+	int entry = u_boneOffset + bone * 4;
+	return mat4(b_bonePalette[entry], b_bonePalette[entry + 1], b_bonePalette[entry + 2], b_bonePalette[entry + 3]);
+}
+
+// Blend the dual quaternions of all influences, flipping the ones on the
+// other hemisphere to the first, then convert the result to a matrix.
+mat4 BlendDualQuaternions()
+{
+	vec4 pivot = b_bonePalette[u_boneOffset + GetBoneId(0) * 2];
+	vec4 real = vec4(0.0);
+	vec4 dual = vec4(0.0);
+	for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+	{
+		int entry = u_boneOffset + GetBoneId(i) * 2;
+		float weight = dot(b_bonePalette[entry], pivot) < 0.0 ? -GetWeight(i) : GetWeight(i);
+		real += b_bonePalette[entry] * weight;
+		dual += b_bonePalette[entry + 1] * weight;
+	}
+	float len = length(real);
+	real /= len;
+	dual /= len;
+
+	float x = real.x, y = real.y, z = real.z, w = real.w;
+	vec3 translation = 2.0 * (w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+	return mat4(
+		vec4(1.0 - 2.0 * (y * y + z * z), 2.0 * (x * y + w * z), 2.0 * (x * z - w * y), 0.0),
+		vec4(2.0 * (x * y - w * z), 1.0 - 2.0 * (x * x + z * z), 2.0 * (y * z + w * x), 0.0),
+		vec4(2.0 * (x * z + w * y), 2.0 * (y * z - w * x), 1.0 - 2.0 * (x * x + y * y), 0.0),
+		vec4(translation, 1.0)
+	);
+}
+
+mat4 GetBoneTransform(int bone)
+{
+	if (!u_baked)
+	{
+		return GetPaletteBone(bone);
+	}
+	int frameCount = textureSize(u_bakedPalette, 0).y;
+	float frame = u_bakedTime * float(frameCount - 1);
+	int frame0 = min(int(frame), frameCount - 1);
+	int frame1 = min(frame0 + 1, frameCount - 1);
+	float t = frame - float(frame0);
+	return FetchBakedBone(bone, frame0) * (1.0 - t) + FetchBakedBone(bone, frame1) * t;
+}
+
 void main()
 {
 	v_color = a_color;
 	v_uvs = a_uvs;
 	
 	mat4 boneTransform = mat4(0.0);
-	if (u_animated)
+	if (u_animated && !u_baked && u_paletteFormat == PALETTE_DUAL_QUATERNION)
 	{
-		boneTransform += u_boneTransforms[a_boneIds[0]] * a_weights[0];
-		boneTransform += u_boneTransforms[a_boneIds[1]] * a_weights[1];
-		boneTransform += u_boneTransforms[a_boneIds[2]] * a_weights[2];
-		boneTransform += u_boneTransforms[a_boneIds[3]] * a_weights[3];
+		boneTransform = BlendDualQuaternions();
+		
+		if (a_weights[0] == 0.0)
+		{
+			boneTransform = mat4(1.0);
+		}
+	}
+	else if (u_animated)
+	{
+		for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+		{
+			boneTransform += GetBoneTransform(GetBoneId(i)) * GetWeight(i);
+		}
 		
 		if (a_weights[0] == 0.0)
 		{
@@ -47,10 +159,13 @@ void main()
 	}
 	
 	vec4 pos = boneTransform * vec4(a_position, 1.0);
-	vec4 normal = boneTransform * vec4(a_normal, 0.0);
+	vec3 vertexNormal = OctDecode(a_normal);
+	vec4 normal = boneTransform * vec4(vertexNormal, 0.0);
 	
-	vec3 t = normalize(vec3(u_modelMatrix * vec4(a_tangent, 0.0)));
-	vec3 b = normalize(vec3(u_modelMatrix * vec4(a_bitangent, 0.0)));
+	vec3 vertexTangent = OctDecode(a_tangent.xy);
+	vec3 vertexBitangent = cross(vertexNormal, vertexTangent) * a_tangent.z;
+	vec3 t = normalize(vec3(u_modelMatrix * vec4(vertexTangent, 0.0)));
+	vec3 b = normalize(vec3(u_modelMatrix * vec4(vertexBitangent, 0.0)));
 	vec3 n = normalize(vec3(u_modelMatrix * normal));
 	
 	v_tbn = mat3(
@@ -1,7 +1,23 @@
 //These includes are specific to the way weve set up GLFW and GLAD.
 #include "ProgramManager.h"
-int main(void)
+int main(int argc, char** argv)
 {
+    // command line tools, they exit without a window:
+    // --compile <file.dae|file.obj>... writes the binary cache of every file,
+    // --compile-animations caches only the clips of clip files,
+    // --benchmark-import times the mesh conversion against the per vertex code
+    std::string tool = argc > 1 ? argv[1] : "";
+    if (tool == "--compile" || tool == "--compile-animations" || tool == "--benchmark-import")
+    {
+        JobSystem jobSystem;
+        InitJobSystem(&jobSystem);
+        std::vector<std::string> sourcePaths(argv + 2, argv + argc);
+        bool succeeded = tool == "--benchmark-import" ? BenchmarkImport(sourcePaths, &jobSystem)
+            : CompileAssets(sourcePaths, tool == "--compile" ? fullImportProfile : animationImportProfile, &jobSystem);
+        DestroyJobSystem(&jobSystem);
+        return succeeded ? 0 : 1;
+    }
+
     ProgramManager programManager;
     if (programManager.Init())
     {